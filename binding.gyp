@@ -40,12 +40,34 @@
             }
           },
           "sources": [
+            "video_reader/analysis_scheduler.cpp",
+            "video_reader/analysis_scheduler.h",
+            "video_reader/analysis_scheduler_wrapper.cpp",
+            "video_reader/analysis_scheduler_wrapper.h",
+            "video_reader/audio_analysis.cpp",
+            "video_reader/audio_analysis.h",
+            "video_reader/media_io.cpp",
+            "video_reader/media_io.h",
+            "video_reader/metrics.cpp",
+            "video_reader/metrics.h",
+            "video_reader/model_descriptor.cpp",
+            "video_reader/model_descriptor.h",
+            "video_reader/screenshot_archive.cpp",
+            "video_reader/screenshot_archive.h",
+            "video_reader/shot_model.cpp",
+            "video_reader/shot_model.h",
+            "video_reader/tone_mapping.cpp",
+            "video_reader/tone_mapping.h",
+            "video_reader/video_probe.cpp",
+            "video_reader/video_probe.h",
             "video_reader/video_reader.cpp",
             "video_reader/video_reader.h",
             "video_reader/video_reader_wrapper.cpp",
             "video_reader/video_reader_wrapper.h",
             "video_reader/worker.cpp",
             "video_reader/worker.h",
+            "video_reader/zip_writer.cpp",
+            "video_reader/zip_writer.h",
           ],
           "libraries": [
             "<(module_root_dir)/onnxlibs/lib/onnxruntime.lib",
@@ -79,12 +101,34 @@
         }],
         ["OS!='win'", {
           "sources": [
+            "video_reader/analysis_scheduler.cpp",
+            "video_reader/analysis_scheduler.h",
+            "video_reader/analysis_scheduler_wrapper.cpp",
+            "video_reader/analysis_scheduler_wrapper.h",
+            "video_reader/audio_analysis.cpp",
+            "video_reader/audio_analysis.h",
+            "video_reader/media_io.cpp",
+            "video_reader/media_io.h",
+            "video_reader/metrics.cpp",
+            "video_reader/metrics.h",
+            "video_reader/model_descriptor.cpp",
+            "video_reader/model_descriptor.h",
+            "video_reader/screenshot_archive.cpp",
+            "video_reader/screenshot_archive.h",
+            "video_reader/shot_model.cpp",
+            "video_reader/shot_model.h",
+            "video_reader/tone_mapping.cpp",
+            "video_reader/tone_mapping.h",
+            "video_reader/video_probe.cpp",
+            "video_reader/video_probe.h",
             "video_reader/video_reader.cpp",
             "video_reader/video_reader.h",
             "video_reader/video_reader_wrapper.cpp",
             "video_reader/video_reader_wrapper.h",
             "video_reader/worker.cpp",
             "video_reader/worker.h",
+            "video_reader/zip_writer.cpp",
+            "video_reader/zip_writer.h",
             "ffmpeglibs/lib/libavcodec.a",
             "ffmpeglibs/lib/libavdevice.a",
             "ffmpeglibs/lib/libavfilter.a",
@@ -127,4 +171,95 @@
       ]
     }
   ],
+  "conditions": [
+    ["OS!='win'", {
+      "targets": [
+        {
+          "target_name": "video_reader_benchmark",
+          "type": "executable",
+          "include_dirs": [
+            "ffmpeglibs/include",
+            "onnxlibs/include",
+          ],
+          "cflags_cc": [
+            "-fexceptions"
+          ],
+          "sources": [
+            "video_reader/audio_analysis.cpp",
+            "video_reader/benchmark.cpp",
+            "video_reader/media_io.cpp",
+            "video_reader/metrics.cpp",
+            "video_reader/model_descriptor.cpp",
+            "video_reader/screenshot_archive.cpp",
+            "video_reader/shot_model.cpp",
+            "video_reader/tone_mapping.cpp",
+            "video_reader/video_probe.cpp",
+            "video_reader/video_reader.cpp",
+            "video_reader/zip_writer.cpp",
+          ],
+          "libraries": [
+            "<(module_root_dir)/ffmpeglibs/lib/libavcodec.a",
+            "<(module_root_dir)/ffmpeglibs/lib/libavdevice.a",
+            "<(module_root_dir)/ffmpeglibs/lib/libavfilter.a",
+            "<(module_root_dir)/ffmpeglibs/lib/libavformat.a",
+            "<(module_root_dir)/ffmpeglibs/lib/libavutil.a",
+            "<(module_root_dir)/ffmpeglibs/lib/libswresample.a",
+            "<(module_root_dir)/ffmpeglibs/lib/libswscale.a",
+            "<(module_root_dir)/onnxlibs/lib/libonnxruntime.a",
+            "-lm",
+            "-lpthread",
+            "-lstdc++",
+            "-lc"
+          ],
+          "xcode_settings": {
+            "MACOSX_DEPLOYMENT_TARGET": "14",
+            "OTHER_CFLAGS": ["-fexceptions"],
+          }
+        },
+        {
+          "target_name": "video_reader_cli",
+          "type": "executable",
+          "include_dirs": [
+            "ffmpeglibs/include",
+            "onnxlibs/include",
+          ],
+          "cflags_cc": [
+            "-fexceptions"
+          ],
+          "sources": [
+            "video_reader/analysis_scheduler.cpp",
+            "video_reader/audio_analysis.cpp",
+            "video_reader/media_io.cpp",
+            "video_reader/metrics.cpp",
+            "video_reader/model_descriptor.cpp",
+            "video_reader/screenshot_archive.cpp",
+            "video_reader/shot_model.cpp",
+            "video_reader/tone_mapping.cpp",
+            "video_reader/video_probe.cpp",
+            "video_reader/video_reader.cpp",
+            "video_reader/video_reader_cli.cpp",
+            "video_reader/zip_writer.cpp",
+          ],
+          "libraries": [
+            "<(module_root_dir)/ffmpeglibs/lib/libavcodec.a",
+            "<(module_root_dir)/ffmpeglibs/lib/libavdevice.a",
+            "<(module_root_dir)/ffmpeglibs/lib/libavfilter.a",
+            "<(module_root_dir)/ffmpeglibs/lib/libavformat.a",
+            "<(module_root_dir)/ffmpeglibs/lib/libavutil.a",
+            "<(module_root_dir)/ffmpeglibs/lib/libswresample.a",
+            "<(module_root_dir)/ffmpeglibs/lib/libswscale.a",
+            "<(module_root_dir)/onnxlibs/lib/libonnxruntime.a",
+            "-lm",
+            "-lpthread",
+            "-lstdc++",
+            "-lc"
+          ],
+          "xcode_settings": {
+            "MACOSX_DEPLOYMENT_TARGET": "14",
+            "OTHER_CFLAGS": ["-fexceptions"],
+          }
+        }
+      ]
+    }]
+  ],
 }
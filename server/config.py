@@ -14,7 +14,8 @@ DATABASE_URL = os.environ.get('VIAN_DATABASE_URL', 'sqlite:///database.db')
 REDIS_URL = os.environ.get('VIAN_REDIS_URL', 'redis://localhost:6379/0')
 
 # resources
-ONNXMODEL = '../resources/transnetv2.onnx'
+# e.g. a quantized variant made with video_reader/quantize_model.py on CPU-only nodes
+ONNXMODEL = os.environ.get('VIAN_ONNXMODEL', '../resources/transnetv2.onnx')
 
 # page path
 API_PREFIX = os.environ.get('VIAN_API_PREFIX', '/api/')
@@ -5,8 +5,18 @@ from setuptools import setup
 ext_modules = [
     Pybind11Extension(
         'video_reader',
-        ['../video_reader/video_reader.cpp',
+        ['../video_reader/analysis_scheduler.cpp',
+         '../video_reader/audio_analysis.cpp',
+         '../video_reader/media_io.cpp',
+         '../video_reader/metrics.cpp',
+         '../video_reader/model_descriptor.cpp',
+         '../video_reader/screenshot_archive.cpp',
+         '../video_reader/shot_model.cpp',
+         '../video_reader/tone_mapping.cpp',
+         '../video_reader/video_probe.cpp',
+         '../video_reader/video_reader.cpp',
          '../video_reader/python_wrapper.cpp',
+         '../video_reader/zip_writer.cpp',
          ],
         include_dirs=[
             pybind11.get_include(),
@@ -41,20 +41,21 @@ def get_video_info(video: str, job: int) -> dict|None:
         session = next(db.get_session())
         db.update_job(session, job, status='RUNNING')
 
-        reader = video_reader.VideoReader(video)  # type: ignore
-        reader.open()
-        fps = reader.get_frame_rate()
-        height = reader.get_height()
-        width = reader.get_width()
-        num_frames = reader.get_numframes()
+        # Reads the container headers only, no decoder is opened
+        info = video_reader.probe_video(video)  # type: ignore
 
         db.update_job(session, job, status='DONE')
         db.create_result(
             session,
             job,
-            {'fps': fps, 'height': height, 'width': width, 'numFrames': num_frames}
+            {
+                'fps': info['fps'],
+                'height': info['height'],
+                'width': info['width'],
+                'numFrames': info['numFrames']
+            }
         )
-        return {'fps': fps}
+        return {'fps': info['fps']}
     except Exception:
         logger.exception('Exception during video info')
         db.update_job(next(db.get_session()), job, status='ERROR')
@@ -70,9 +71,14 @@ def shotboundary_detection(self: Task, video: str, job: int) -> list|None:
 
         reader = video_reader.VideoReader(video)  # type: ignore
         reader.open()
-        shots = reader.detect_shots(ONNXMODEL)
-
-        if self.AsyncResult(self.request.id).state == 'REVOKED':
+        # A revoke terminates with SIGTERM, which stops the reader and its
+        # progress reports
+        try:
+            shots = reader.detect_shots(
+                ONNXMODEL,
+                on_progress=lambda p: self.update_state(state='PROGRESS', meta=p)
+            )
+        except video_reader.OperationCancelled:  # type: ignore
             db.update_job(session, job, status='CANCELED')
             return None
 
@@ -100,14 +106,18 @@ def screenshots_generation(
 
         reader = video_reader.VideoReader(video)  # type: ignore
         reader.open()
-        success = reader.generate_screenshots(str(DATA_DIR / directory), frames)
-
-        if success != 0:
-            db.update_job(session, job, status='ERROR')
+        try:
+            written = reader.generate_screenshots(
+                str(DATA_DIR / directory),
+                frames,
+                on_progress=lambda p: self.update_state(state='PROGRESS', meta=p)
+            )
+        except video_reader.OperationCancelled:  # type: ignore
+            db.update_job(session, job, status='CANCELED')
             return None
 
-        if self.AsyncResult(self.request.id).state == 'REVOKED':
-            db.update_job(session, job, status='CANCELED')
+        if written < 0:
+            db.update_job(session, job, status='ERROR')
             return None
 
         screenshots = [
@@ -173,37 +183,31 @@ def export_screenshots(
 ) -> str|None:
     logger.info('Starting screenshots export')
 
-    def time_sec(t: float) -> str:
-        hours = int(t / 3600)
-        minutes = int((t % 3600) / 60)
-        seconds = f'{(t % 60):.2f}'.replace('.', ',')
-        return f'{hours:02}:{minutes:02}:{seconds}'
-
     try:
         session = next(db.get_session())
         db.update_job(session, job, status='RUNNING')
         zip_path = EXPORT_DIR / f'screenshots-{uuid.uuid4()}.zip'
-        with ZipFile(DATA_DIR / zip_path, 'w', ZIP_DEFLATED) as zipf:
-            for timeline in timelines:
-                if not timeline['type'].startswith('screenshots'):
+        frame_dir = DATA_DIR / SCREENSHOT_UPLOAD_DIR / projectid
+        screenshots = []
+        for timeline in timelines:
+            if not timeline['type'].startswith('screenshots'):
+                continue
+            for f in timeline['data']:
+                if frames is not None and f['frame'] not in frames:
                     continue
-
-                timeline_frames = [
-                    f['image'].split('/')[-1]
-                    for f in timeline['data']
-                    if frames is None or f['frame'] in frames
-                ]
-                t_path = timeline['name'] + ' - ' + timeline['id']
-                if len(timeline_frames) > 0:
-                    zipf.mkdir(t_path)
-
-                frame_dir = DATA_DIR / SCREENSHOT_UPLOAD_DIR / projectid
-                for frame in timeline_frames:
-                    frame_name = time_sec(int(frame.removesuffix('.jpg'))/fps) + '.jpg'
-                    zipf.write(
-                        frame_dir / frame,
-                        t_path + '/' + frame_name
-                    )
+                image = f['image'].split('/')[-1]
+                screenshots.append({
+                    'directory': timeline['name'] + ' - ' + timeline['id'],
+                    'frame': int(image.removesuffix('.jpg')),
+                    'source': str(frame_dir / image),
+                })
+
+        # Entries are named by timecode, like the desktop export
+        written = video_reader.export_screenshot_files(  # type: ignore
+            str(DATA_DIR / zip_path), screenshots, fps
+        )
+        if written < 0:
+            raise RuntimeError('Failed to write screenshot archive')
         zip_path = API_PREFIX + str(zip_path)
         db.update_job(session, job, status='DONE')
         db.create_result(session, job, zip_path)
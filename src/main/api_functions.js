@@ -52,6 +52,14 @@ class JobManager {
     }
   }
 
+  updateJobProgress(channel, jobId, progress) {
+    const job = this.jobs.get(jobId)
+    if (job) {
+      job.progress = progress
+      this.sendJobsUpdate(channel)
+    }
+  }
+
   terminateJob(jobId) {
     const job = this.jobs.get(jobId)
     if (!job) return false
@@ -159,6 +167,10 @@ export const runShotBoundaryDetection = (channel, videoPath) => {
   const job = jobManager.createWorkerJob(channel, 'shotboundary-detection', worker)
 
   worker.on('message', (data) => {
+    if (data.progress) {
+      jobManager.updateJobProgress(channel, job.id, data.progress)
+      return
+    }
     jobManager.updateJobStatus(channel, job.id, data.status)
     if (data.status === 'DONE') {
       channel.sender.send('shotboundary-detected', data.shots)
@@ -176,6 +188,10 @@ export const runScreenshotsGeneration = (channel, videoPath, frames, videoId) =>
   const job = jobManager.createWorkerJob(channel, 'screenshots-generation', worker)
 
   worker.on('message', (data) => {
+    if (data.progress) {
+      jobManager.updateJobProgress(channel, job.id, data.progress)
+      return
+    }
     jobManager.updateJobStatus(channel, job.id, data.status)
     if (data.status === 'DONE') {
       channel.sender.send('screenshots-generated', data.data)
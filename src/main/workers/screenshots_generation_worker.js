@@ -8,9 +8,14 @@ console.log('Started worker to generate screenshots', workerData)
 
 const reader = new videoReader.VideoReader(workerData.videoPath)
 reader.open()
-reader.generateScreenshots(workerData.directory, workerData.frames, (err, result) => {
+const onProgress = (event) => {
+  if (event.type === 'progress') {
+    parentPort.postMessage({ progress: event, status: 'RUNNING' })
+  }
+}
+reader.generateScreenshots(workerData.directory, workerData.frames, onProgress, (err, result) => {
   if (err) {
-    parentPort.postMessage({ status: 'CANCELED' })
+    parentPort.postMessage({ status: err.message === 'Operation cancelled' ? 'CANCELED' : 'ERROR' })
   } else if (result) {
     parentPort.postMessage({
       data: workerData.frames.map((f) => {
@@ -8,9 +8,14 @@ console.log('Started worker to detect shot boundaries')
 
 const reader = new videoReader.VideoReader(workerData)
 reader.open()
-reader.detectShots(onnxPath, (err, result) => {
+const onProgress = (event) => {
+  if (event.type === 'progress') {
+    parentPort.postMessage({ progress: event, status: 'RUNNING' })
+  }
+}
+reader.detectShots(onnxPath, onProgress, (err, result) => {
   if (err) {
-    parentPort.postMessage({ status: 'CANCELED' })
+    parentPort.postMessage({ status: err.message === 'Operation cancelled' ? 'CANCELED' : 'ERROR' })
   } else {
     parentPort.postMessage({ shots: result, status: 'DONE' })
   }
@@ -5,10 +5,6 @@ const videoReader = require(videoReaderPath)
 
 console.log('Started worker to retrieve video info')
 
-const reader = new videoReader.VideoReader(workerData)
-reader.open()
-const fps = reader.getFrameRate()
-const width = reader.getWidth()
-const height = reader.getHeight()
-const numFrames = reader.getNumFrames()
+// Reads the container headers only, no decoder is opened
+const { fps, height, numFrames, width } = videoReader.probeVideo(workerData)
 parentPort.postMessage({ fps, height, numFrames, width })
@@ -0,0 +1,286 @@
+#include "analysis_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+const char* jobStatusName(JobStatus status) {
+    switch (status) {
+        case JobStatus::Queued: return "QUEUED";
+        case JobStatus::Running: return "RUNNING";
+        case JobStatus::Done: return "DONE";
+        case JobStatus::Error: return "ERROR";
+        case JobStatus::Cancelled: return "CANCELED";
+    }
+    return "UNKNOWN";
+}
+
+namespace {
+
+bool isFinished(JobStatus status) {
+    return status == JobStatus::Done || status == JobStatus::Error || status == JobStatus::Cancelled;
+}
+
+}  // namespace
+
+AnalysisScheduler::AnalysisScheduler(const std::string& onnx_model_path,
+                                     int workers, int inference_threads) {
+    int hardware = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    if (workers <= 0 && inference_threads <= 0) {
+        inference_threads = std::max(1, hardware / 2);
+        workers = std::max(1, hardware - inference_threads);
+    } else if (workers <= 0) {
+        workers = std::max(1, hardware - inference_threads);
+    } else if (inference_threads <= 0) {
+        inference_threads = std::max(1, hardware - workers);
+    }
+
+    if (onnx_model_path.empty()) {
+        model_error = "No shot detection model given";
+    } else {
+        try {
+            model.reset(new ShotModel(onnx_model_path, inference_threads));
+        } catch (const std::exception& e) {
+            model_error = e.what();
+        }
+    }
+
+    for (int i = 0; i < workers; ++i) {
+        threads.emplace_back(&AnalysisScheduler::workerLoop, this);
+    }
+}
+
+AnalysisScheduler::~AnalysisScheduler() {
+    std::vector<std::shared_ptr<Job>> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        // The queue is emptied in one go, finishJob unlocks for the callbacks
+        while (!queue.empty()) {
+            std::shared_ptr<Job> job = queue.top();
+            queue.pop();
+            if (job->result.status == JobStatus::Queued) {
+                job->result.status = JobStatus::Cancelled;
+                cancelled.push_back(job);
+            }
+        }
+        // Jobs that were taken by a worker but have no reader yet stop in runJob
+        for (auto& entry : jobs) {
+            if (entry.second->result.status == JobStatus::Running) {
+                entry.second->result.status = JobStatus::Cancelled;
+                if (entry.second->reader) {
+                    entry.second->reader->cancel();
+                }
+            }
+        }
+    }
+    work_available.notify_all();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (const std::shared_ptr<Job>& job : cancelled) {
+        finishJob(job, lock);
+    }
+    lock.unlock();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+int AnalysisScheduler::submitShotDetection(const std::string& file_path, int priority, Callback done) {
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->result.type = JobType::ShotDetection;
+    job->file_path = file_path;
+    job->priority = priority;
+    job->done = std::move(done);
+    return submit(job);
+}
+
+int AnalysisScheduler::submitScreenshots(const std::string& file_path, const std::string& directory,
+                                         const std::vector<int>& frameStamps, int priority,
+                                         Callback done) {
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->result.type = JobType::Screenshots;
+    job->file_path = file_path;
+    job->directory = directory;
+    job->frameStamps = frameStamps;
+    job->priority = priority;
+    job->done = std::move(done);
+    return submit(job);
+}
+
+int AnalysisScheduler::submitVideoInfo(const std::string& file_path, int priority, Callback done) {
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->result.type = JobType::VideoInfo;
+    job->file_path = file_path;
+    job->priority = priority;
+    job->done = std::move(done);
+    return submit(job);
+}
+
+int AnalysisScheduler::submit(std::shared_ptr<Job> job) {
+    int id;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) {
+            return -1;
+        }
+        id = next_id++;
+        job->result.id = id;
+        job->result.status = JobStatus::Queued;
+        job->sequence = next_sequence++;
+        jobs[id] = job;
+        queue.push(job);
+    }
+    work_available.notify_one();
+    return id;
+}
+
+bool AnalysisScheduler::cancel(int id) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = jobs.find(id);
+    if (it == jobs.end()) {
+        return false;
+    }
+
+    std::shared_ptr<Job> job = it->second;
+    if (job->result.status == JobStatus::Queued) {
+        // The job stays in the queue and is skipped by the workers
+        job->result.status = JobStatus::Cancelled;
+        finishJob(job, lock);
+        return true;
+    }
+    if (job->result.status == JobStatus::Running) {
+        job->result.status = JobStatus::Cancelled;
+        if (job->reader) {
+            job->reader->cancel();
+        }
+        return true;
+    }
+    return false;
+}
+
+JobStatus AnalysisScheduler::status(int id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = jobs.find(id);
+    if (it == jobs.end()) {
+        throw std::invalid_argument("Unknown job id");
+    }
+    return it->second->result.status;
+}
+
+JobResult AnalysisScheduler::wait(int id) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = jobs.find(id);
+    if (it == jobs.end()) {
+        throw std::invalid_argument("Unknown job id");
+    }
+
+    std::shared_ptr<Job> job = it->second;
+    job_finished.wait(lock, [&job] { return isFinished(job->result.status) && !job->reader; });
+    jobs.erase(id);
+    return job->result;
+}
+
+size_t AnalysisScheduler::pending() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::count_if(jobs.begin(), jobs.end(), [](const std::pair<const int, std::shared_ptr<Job>>& entry) {
+        return !isFinished(entry.second->result.status);
+    });
+}
+
+int AnalysisScheduler::workerCount() const {
+    return static_cast<int>(threads.size());
+}
+
+void AnalysisScheduler::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work_available.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (stopping) {
+            return;
+        }
+
+        std::shared_ptr<Job> job = queue.top();
+        queue.pop();
+        if (job->result.status != JobStatus::Queued) {
+            continue;
+        }
+        job->result.status = JobStatus::Running;
+
+        lock.unlock();
+        runJob(*job);
+        lock.lock();
+
+        finishJob(job, lock);
+    }
+}
+
+void AnalysisScheduler::runJob(Job& job) {
+    VideoReader reader(job.file_path);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (job.result.status == JobStatus::Cancelled) {
+            return;
+        }
+        job.reader = &reader;
+    }
+
+    JobStatus status = JobStatus::Done;
+    std::string error;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    try {
+        if (job.result.type == JobType::VideoInfo) {
+            // Read from the container headers, no decoder is opened
+            if (!probeVideo(job.file_path, job.result.info)) {
+                status = JobStatus::Error;
+                error = "Failed to probe " + job.file_path;
+            }
+        } else if (!reader.Open()) {
+            status = JobStatus::Error;
+            error = "Failed to open " + job.file_path;
+        } else if (job.result.type == JobType::ShotDetection) {
+            if (model) {
+                job.result.shots = reader.DetectShots(*model);
+            } else {
+                status = JobStatus::Error;
+                error = model_error;
+            }
+        } else if (job.result.type == JobType::Screenshots) {
+            job.result.screenshots = reader.generateScreenshots(job.directory, job.frameStamps);
+        }
+
+        // Empty shots or -1 screenshots of a failed or stopped reader are no result
+        if (status == JobStatus::Done && reader.lastStatus() == OperationStatus::Cancelled) {
+            status = JobStatus::Cancelled;
+        } else if (status == JobStatus::Done && reader.lastStatus() == OperationStatus::Failed) {
+            status = JobStatus::Error;
+            error = reader.lastError();
+        }
+    } catch (const std::exception& e) {
+        status = JobStatus::Error;
+        error = e.what();
+    }
+    job.result.elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    job.result.metrics = reader.getMetrics();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    job.reader = nullptr;
+    if (job.result.status != JobStatus::Cancelled) {
+        job.result.status = status;
+        job.result.error = error;
+    }
+}
+
+void AnalysisScheduler::finishJob(const std::shared_ptr<Job>& job, std::unique_lock<std::mutex>& lock) {
+    if (!job->done) {
+        job_finished.notify_all();
+        return;
+    }
+
+    jobs.erase(job->result.id);
+    JobResult result = job->result;
+    Callback done = std::move(job->done);
+    lock.unlock();
+    done(result);
+    lock.lock();
+}
@@ -0,0 +1,110 @@
+#ifndef ANALYSIS_SCHEDULER_H
+#define ANALYSIS_SCHEDULER_H
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shot_model.h"
+#include "video_probe.h"
+#include "video_reader.h"
+
+enum class JobType { ShotDetection, Screenshots, VideoInfo };
+enum class JobStatus { Queued, Running, Done, Error, Cancelled };
+
+const char* jobStatusName(JobStatus status);
+
+struct JobResult {
+    int id = -1;
+    JobType type = JobType::VideoInfo;
+    JobStatus status = JobStatus::Queued;
+    std::string error;
+    std::vector<std::vector<int>> shots;  // ShotDetection
+    int screenshots = 0;                  // Screenshots, number written
+    VideoInfo info;                       // VideoInfo
+    double elapsedMs = 0.0;               // Wall time from opening the video to the end of the job
+    MetricsSnapshot metrics;              // Per-stage timings of the job's reader
+};
+
+// Runs analysis jobs for many videos in one process. All shot detection jobs
+// share one ONNX session whose intra-op pool is sized together with the
+// decoding workers, so running several jobs does not oversubscribe the cores.
+// Jobs with a higher priority are started first, jobs of equal priority in
+// submission order.
+class AnalysisScheduler {
+public:
+    using Callback = std::function<void(const JobResult&)>;
+
+    // workers and inference_threads <= 0 split the hardware threads between them
+    explicit AnalysisScheduler(const std::string& onnx_model_path,
+                               int workers = 0, int inference_threads = 0);
+    ~AnalysisScheduler();
+
+    AnalysisScheduler(const AnalysisScheduler&) = delete;
+    AnalysisScheduler& operator=(const AnalysisScheduler&) = delete;
+
+    // If done is given it is called from a worker thread when the job has
+    // finished, otherwise the result is kept until wait() is called. Returns
+    // the job id, or -1 without calling done once the scheduler is being
+    // destroyed, e.g. when a done callback of a cancelled job submits more.
+    int submitShotDetection(const std::string& file_path, int priority = 0,
+                            Callback done = nullptr);
+    int submitScreenshots(const std::string& file_path, const std::string& directory,
+                          const std::vector<int>& frameStamps, int priority = 0,
+                          Callback done = nullptr);
+    int submitVideoInfo(const std::string& file_path, int priority = 0,
+                        Callback done = nullptr);
+
+    bool cancel(int id);
+    JobStatus status(int id) const;
+    JobResult wait(int id);
+    size_t pending() const;
+    int workerCount() const;
+
+private:
+    struct Job {
+        JobResult result;
+        int priority = 0;
+        uint64_t sequence = 0;
+        std::string file_path;
+        std::string directory;
+        std::vector<int> frameStamps;
+        Callback done;
+        VideoReader* reader = nullptr;  // Set while the job is running
+    };
+
+    struct JobOrder {
+        bool operator()(const std::shared_ptr<Job>& a, const std::shared_ptr<Job>& b) const {
+            if (a->priority != b->priority) {
+                return a->priority < b->priority;
+            }
+            return a->sequence > b->sequence;
+        }
+    };
+
+    int submit(std::shared_ptr<Job> job);
+    void workerLoop();
+    void runJob(Job& job);
+    void finishJob(const std::shared_ptr<Job>& job, std::unique_lock<std::mutex>& lock);
+
+    std::unique_ptr<ShotModel> model;
+    std::string model_error;
+
+    mutable std::mutex mutex;
+    std::condition_variable work_available;
+    std::condition_variable job_finished;
+    std::priority_queue<std::shared_ptr<Job>, std::vector<std::shared_ptr<Job>>, JobOrder> queue;
+    std::map<int, std::shared_ptr<Job>> jobs;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+    int next_id = 0;
+    uint64_t next_sequence = 0;
+};
+
+#endif
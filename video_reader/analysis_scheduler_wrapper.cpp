@@ -0,0 +1,168 @@
+#include "analysis_scheduler_wrapper.h"
+
+namespace {
+
+Napi::Value ResultToValue(Napi::Env env, const JobResult& result) {
+    if (result.type == JobType::ShotDetection) {
+        Napi::Array shotsArray = Napi::Array::New(env, result.shots.size());
+        for (size_t i = 0; i < result.shots.size(); ++i) {
+            Napi::Array shotArray = Napi::Array::New(env, 2);
+            shotArray.Set(0u, Napi::Number::New(env, result.shots[i][0]));
+            shotArray.Set(1u, Napi::Number::New(env, result.shots[i][1]));
+            shotsArray.Set(i, shotArray);
+        }
+        return shotsArray;
+    }
+    if (result.type == JobType::Screenshots) {
+        return Napi::Boolean::New(env, result.screenshots >= 0);
+    }
+
+    Napi::Object info = Napi::Object::New(env);
+    info.Set("fps", Napi::Number::New(env, result.info.fps));
+    info.Set("width", Napi::Number::New(env, result.info.width));
+    info.Set("height", Napi::Number::New(env, result.info.height));
+    info.Set("numFrames", Napi::Number::New(env, result.info.numFrames));
+    return info;
+}
+
+void CallDone(Napi::Env env, Napi::Function jsCallback, JobResult* result) {
+    if (env != nullptr && jsCallback != nullptr) {
+        if (result->status == JobStatus::Done) {
+            jsCallback.Call({env.Null(), ResultToValue(env, *result)});
+        } else {
+            std::string message = result->status == JobStatus::Cancelled
+                ? "Operation cancelled" : result->error;
+            jsCallback.Call({Napi::Error::New(env, message).Value(), env.Undefined()});
+        }
+    }
+    delete result;
+}
+
+// The callback of a job the scheduler refused never runs, so its function
+// has to be released here or it keeps the event loop alive
+Napi::Value SubmittedJob(Napi::Env env, int id, Napi::ThreadSafeFunction& tsfn) {
+    if (id < 0) {
+        tsfn.Release();
+        throw Napi::Error::New(env, "Scheduler is shutting down");
+    }
+    return Napi::Number::New(env, id);
+}
+
+int PriorityArgument(const Napi::CallbackInfo& info, size_t index) {
+    if (info.Length() > index + 1 && info[index].IsNumber()) {
+        return info[index].As<Napi::Number>().Int32Value();
+    }
+    return 0;
+}
+
+}  // namespace
+
+Napi::Object AnalysisSchedulerWrapper::Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "AnalysisScheduler", {
+        InstanceMethod<&AnalysisSchedulerWrapper::DetectShots>("detectShots"),
+        InstanceMethod<&AnalysisSchedulerWrapper::GenerateScreenshots>("generateScreenshots"),
+        InstanceMethod<&AnalysisSchedulerWrapper::VideoInfo>("videoInfo"),
+        InstanceMethod<&AnalysisSchedulerWrapper::Cancel>("cancel"),
+        InstanceMethod<&AnalysisSchedulerWrapper::Pending>("pending"),
+    });
+
+    exports.Set("AnalysisScheduler", func);
+    return exports;
+}
+
+// new AnalysisScheduler(modelPath, [workers], [inferenceThreads])
+AnalysisSchedulerWrapper::AnalysisSchedulerWrapper(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<AnalysisSchedulerWrapper>(info) {
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(info.Env(), "Model path is required").ThrowAsJavaScriptException();
+        return;
+    }
+
+    std::string modelPath = info[0].As<Napi::String>();
+    int workers = info.Length() > 1 && info[1].IsNumber() ? info[1].As<Napi::Number>().Int32Value() : 0;
+    int inferenceThreads = info.Length() > 2 && info[2].IsNumber() ? info[2].As<Napi::Number>().Int32Value() : 0;
+    scheduler = std::make_unique<AnalysisScheduler>(modelPath, workers, inferenceThreads);
+}
+
+AnalysisScheduler::Callback AnalysisSchedulerWrapper::MakeCallback(const Napi::CallbackInfo& info,
+                                                                  Napi::ThreadSafeFunction& tsfn) {
+    if (info.Length() < 1 || !info[info.Length() - 1].IsFunction()) {
+        throw Napi::TypeError::New(info.Env(), "Last argument must be a callback function");
+    }
+
+    tsfn = Napi::ThreadSafeFunction::New(
+        info.Env(), info[info.Length() - 1].As<Napi::Function>(), "AnalysisSchedulerJob", 0, 1);
+
+    return [tsfn](const JobResult& result) mutable {
+        JobResult* copy = new JobResult(result);
+        if (tsfn.BlockingCall(copy, CallDone) != napi_ok) {
+            delete copy;
+        }
+        tsfn.Release();
+    };
+}
+
+// detectShots(videoPath, [priority], callback) -> job id
+Napi::Value AnalysisSchedulerWrapper::DetectShots(const Napi::CallbackInfo& info) {
+    if (info.Length() < 2 || !info[0].IsString()) {
+        throw Napi::TypeError::New(info.Env(), "Expected video path and callback function");
+    }
+
+    std::string path = info[0].As<Napi::String>();
+    Napi::ThreadSafeFunction tsfn;
+    int id = scheduler->submitShotDetection(path, PriorityArgument(info, 1), MakeCallback(info, tsfn));
+    return SubmittedJob(info.Env(), id, tsfn);
+}
+
+// generateScreenshots(videoPath, directory, frames, [priority], callback) -> job id
+Napi::Value AnalysisSchedulerWrapper::GenerateScreenshots(const Napi::CallbackInfo& info) {
+    if (info.Length() < 4 || !info[0].IsString() || !info[1].IsString() || !info[2].IsArray()) {
+        throw Napi::TypeError::New(info.Env(),
+            "Video path, directory path, frame stamps array and callback are required");
+    }
+
+    std::string path = info[0].As<Napi::String>();
+    std::string directory = info[1].As<Napi::String>();
+    Napi::Array frameStampsArray = info[2].As<Napi::Array>();
+
+    std::vector<int> frameStamps;
+    for (size_t i = 0; i < frameStampsArray.Length(); ++i) {
+        Napi::Value elem = frameStampsArray[i];
+
+        if (!elem.IsNumber()) {
+            throw Napi::TypeError::New(info.Env(),
+                "Frame stamp must be an array of integers");
+        }
+
+        frameStamps.push_back(elem.As<Napi::Number>());
+    }
+
+    Napi::ThreadSafeFunction tsfn;
+    int id = scheduler->submitScreenshots(path, directory, frameStamps,
+                                          PriorityArgument(info, 3), MakeCallback(info, tsfn));
+    return SubmittedJob(info.Env(), id, tsfn);
+}
+
+// videoInfo(videoPath, [priority], callback) -> job id
+Napi::Value AnalysisSchedulerWrapper::VideoInfo(const Napi::CallbackInfo& info) {
+    if (info.Length() < 2 || !info[0].IsString()) {
+        throw Napi::TypeError::New(info.Env(), "Expected video path and callback function");
+    }
+
+    std::string path = info[0].As<Napi::String>();
+    Napi::ThreadSafeFunction tsfn;
+    int id = scheduler->submitVideoInfo(path, PriorityArgument(info, 1), MakeCallback(info, tsfn));
+    return SubmittedJob(info.Env(), id, tsfn);
+}
+
+Napi::Value AnalysisSchedulerWrapper::Cancel(const Napi::CallbackInfo& info) {
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        throw Napi::TypeError::New(info.Env(), "Job id is required");
+    }
+    bool cancelled = scheduler->cancel(info[0].As<Napi::Number>().Int32Value());
+    return Napi::Boolean::New(info.Env(), cancelled);
+}
+
+Napi::Value AnalysisSchedulerWrapper::Pending(const Napi::CallbackInfo& info) {
+    return Napi::Number::New(info.Env(), static_cast<double>(scheduler->pending()));
+}
@@ -0,0 +1,24 @@
+#ifndef ANALYSIS_SCHEDULER_WRAPPER_H
+#define ANALYSIS_SCHEDULER_WRAPPER_H
+
+#include <napi.h>
+#include "analysis_scheduler.h"
+
+class AnalysisSchedulerWrapper : public Napi::ObjectWrap<AnalysisSchedulerWrapper> {
+public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+    AnalysisSchedulerWrapper(const Napi::CallbackInfo& info);
+
+private:
+    std::unique_ptr<AnalysisScheduler> scheduler;
+
+    Napi::Value DetectShots(const Napi::CallbackInfo& info);
+    Napi::Value GenerateScreenshots(const Napi::CallbackInfo& info);
+    Napi::Value VideoInfo(const Napi::CallbackInfo& info);
+    Napi::Value Cancel(const Napi::CallbackInfo& info);
+    Napi::Value Pending(const Napi::CallbackInfo& info);
+    // tsfn is the function the callback calls, released by the callback
+    AnalysisScheduler::Callback MakeCallback(const Napi::CallbackInfo& info, Napi::ThreadSafeFunction& tsfn);
+};
+
+#endif
@@ -0,0 +1,262 @@
+#include "audio_analysis.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const size_t REDUCE_LANES = 8;
+
+float toDb(double level) {
+    if (level <= 0.0) {
+        return SILENCE_DB;
+    }
+    return std::max(SILENCE_DB, static_cast<float>(20.0 * std::log10(level)));
+}
+
+}  // namespace
+
+void reduceSamples(const float* samples, size_t count, float& peak, float& sumSquares) {
+    float peaks[REDUCE_LANES] = {};
+    float sums[REDUCE_LANES] = {};
+
+    size_t i = 0;
+    for (; i + REDUCE_LANES <= count; i += REDUCE_LANES) {
+        for (size_t lane = 0; lane < REDUCE_LANES; ++lane) {
+            float value = samples[i + lane];
+            float magnitude = std::fabs(value);
+            peaks[lane] = magnitude > peaks[lane] ? magnitude : peaks[lane];
+            sums[lane] += value * value;
+        }
+    }
+    for (; i < count; ++i) {
+        float magnitude = std::fabs(samples[i]);
+        peaks[0] = magnitude > peaks[0] ? magnitude : peaks[0];
+        sums[0] += samples[i] * samples[i];
+    }
+
+    peak = 0.0f;
+    sumSquares = 0.0f;
+    for (size_t lane = 0; lane < REDUCE_LANES; ++lane) {
+        peak = std::max(peak, peaks[lane]);
+        sumSquares += sums[lane];
+    }
+}
+
+AudioAnalyzer::AudioAnalyzer() {}
+
+AudioAnalyzer::~AudioAnalyzer() {
+    avcodec_free_context(&codec_ctx);
+    swr_free(&swr_ctx);
+    av_frame_free(&frame);
+}
+
+bool AudioAnalyzer::open(const AVStream* stream, const AudioOptions& options, double video_origin) {
+    const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        return false;
+    }
+
+    codec_ctx = avcodec_alloc_context3(codec);
+    frame = av_frame_alloc();
+    if (!codec_ctx || !frame ||
+        avcodec_parameters_to_context(codec_ctx, stream->codecpar) < 0 ||
+        avcodec_open2(codec_ctx, codec, nullptr) < 0) {
+        return false;
+    }
+
+    sample_rate = codec_ctx->sample_rate;
+    channels = codec_ctx->ch_layout.nb_channels;
+    if (sample_rate <= 0 || channels <= 0) {
+        return false;
+    }
+
+    stream_index = stream->index;
+    time_base = stream->time_base;
+    origin = video_origin;
+    envelope_rate = std::max(1, std::min(options.envelopeRate, sample_rate));
+    if (stream->duration != AV_NOPTS_VALUE) {
+        expected_bins = static_cast<size_t>(stream->duration * av_q2d(time_base) * envelope_rate) + 1;
+    }
+    reset();
+    return true;
+}
+
+void AudioAnalyzer::reset() {
+    if (codec_ctx) {
+        avcodec_flush_buffers(codec_ctx);
+    }
+    position = -1;
+    bin_peak.clear();
+    bin_sum.clear();
+    bin_count.clear();
+    // Reserved up front so the envelope does not grow while the video is decoded
+    bin_peak.reserve(expected_bins);
+    bin_sum.reserve(expected_bins);
+    bin_count.reserve(expected_bins);
+}
+
+int AudioAnalyzer::addPacket(const AVPacket* packet) {
+    int response = avcodec_send_packet(codec_ctx, packet);
+    if (response == AVERROR(EAGAIN)) {
+        receiveFrames();
+        response = avcodec_send_packet(codec_ctx, packet);
+    }
+    if (response < 0) {
+        return response;
+    }
+    return receiveFrames();
+}
+
+void AudioAnalyzer::flush() {
+    if (codec_ctx && avcodec_send_packet(codec_ctx, nullptr) >= 0) {
+        receiveFrames();
+    }
+}
+
+int AudioAnalyzer::receiveFrames() {
+    int response;
+    while ((response = avcodec_receive_frame(codec_ctx, frame)) >= 0) {
+        addFrame(frame);
+        av_frame_unref(frame);
+    }
+    return response == AVERROR(EAGAIN) || response == AVERROR_EOF ? 0 : response;
+}
+
+void AudioAnalyzer::addFrame(const AVFrame* decoded) {
+    int count = decoded->nb_samples;
+    int frameChannels = decoded->ch_layout.nb_channels;
+    if (count <= 0 || frameChannels <= 0) {
+        return;
+    }
+
+    // Samples are counted to avoid jitter from rounded timestamps, the
+    // timestamps are only followed at the start and across gaps
+    int64_t first = position < 0 ? 0 : position;
+    if (decoded->pts != AV_NOPTS_VALUE) {
+        int64_t timestamp = llround((decoded->pts * av_q2d(time_base) - origin) * sample_rate);
+        if (position < 0 || timestamp > position + sample_rate / envelope_rate) {
+            first = timestamp;
+        }
+    }
+    position = first + count;
+
+    // Audio before the first video frame is not part of the envelope
+    int skip = first < 0 ? static_cast<int>(std::min<int64_t>(-first, count)) : 0;
+    if (skip == count) {
+        return;
+    }
+
+    plane_ptrs.resize(std::max<size_t>(plane_ptrs.size(), frameChannels));
+    switch (decoded->format) {
+    case AV_SAMPLE_FMT_FLTP:
+        for (int c = 0; c < frameChannels; ++c) {
+            plane_ptrs[c] = reinterpret_cast<const float*>(decoded->extended_data[c]) + skip;
+        }
+        addSamples(plane_ptrs.data(), frameChannels, 1, first + skip, count - skip);
+        break;
+    case AV_SAMPLE_FMT_FLT:
+        plane_ptrs[0] = reinterpret_cast<const float*>(decoded->data[0]) + skip * frameChannels;
+        addSamples(plane_ptrs.data(), 1, frameChannels, first + skip, count - skip);
+        break;
+    default: {
+        // The converter is only recreated if the decoder output changes
+        if (!swr_ctx || swr_format != decoded->format || swr_channels != frameChannels) {
+            swr_free(&swr_ctx);
+            if (swr_alloc_set_opts2(&swr_ctx,
+                                    &decoded->ch_layout, AV_SAMPLE_FMT_FLT, decoded->sample_rate,
+                                    &decoded->ch_layout, static_cast<AVSampleFormat>(decoded->format),
+                                    decoded->sample_rate, 0, nullptr) < 0 ||
+                swr_init(swr_ctx) < 0) {
+                swr_free(&swr_ctx);
+                return;
+            }
+            swr_format = decoded->format;
+            swr_channels = frameChannels;
+        }
+        converted.resize(std::max<size_t>(converted.size(), static_cast<size_t>(count) * frameChannels));
+        uint8_t* out = reinterpret_cast<uint8_t*>(converted.data());
+        int n = swr_convert(swr_ctx, &out, count, const_cast<const uint8_t**>(decoded->extended_data), count);
+        if (n > skip) {
+            plane_ptrs[0] = converted.data() + skip * frameChannels;
+            addSamples(plane_ptrs.data(), 1, frameChannels, first + skip, n - skip);
+        }
+        break;
+    }
+    }
+}
+
+void AudioAnalyzer::addSamples(const float* const* samplePlanes, int planeCount, int interleaved,
+                               int64_t first, int count) {
+    int done = 0;
+    while (done < count) {
+        // Bin b covers the samples from ceil(b * sample_rate / envelope_rate) on
+        size_t bin = static_cast<size_t>((first + done) * envelope_rate / sample_rate);
+        int64_t binEnd = (static_cast<int64_t>(bin + 1) * sample_rate + envelope_rate - 1) / envelope_rate;
+        int take = static_cast<int>(std::min<int64_t>(count - done, binEnd - (first + done)));
+
+        if (bin >= bin_peak.size()) {
+            bin_peak.resize(bin + 1, 0.0f);
+            bin_sum.resize(bin + 1, 0.0);
+            bin_count.resize(bin + 1, 0);
+        }
+
+        for (int p = 0; p < planeCount; ++p) {
+            float peak;
+            float sumSquares;
+            reduceSamples(samplePlanes[p] + static_cast<size_t>(done) * interleaved,
+                          static_cast<size_t>(take) * interleaved, peak, sumSquares);
+            bin_peak[bin] = std::max(bin_peak[bin], peak);
+            bin_sum[bin] += sumSquares;
+        }
+        bin_count[bin] += static_cast<uint32_t>(take) * interleaved * planeCount;
+        done += take;
+    }
+}
+
+AudioAnalysis AudioAnalyzer::result(const std::vector<std::vector<int>>& shots, double fps) const {
+    AudioAnalysis analysis;
+    if (stream_index < 0) {
+        return analysis;
+    }
+
+    analysis.sampleRate = sample_rate;
+    analysis.channels = channels;
+    analysis.envelopeRate = envelope_rate;
+    analysis.peak = bin_peak;
+    analysis.rms.resize(bin_sum.size());
+    for (size_t i = 0; i < bin_sum.size(); ++i) {
+        analysis.rms[i] = bin_count[i] ? static_cast<float>(std::sqrt(bin_sum[i] / bin_count[i])) : 0.0f;
+    }
+
+    if (fps <= 0.0) {
+        return analysis;
+    }
+    for (const std::vector<int>& shot : shots) {
+        if (shot.size() < 2) {
+            continue;
+        }
+        ShotLoudness loudness;
+        loudness.start = shot[0];
+        loudness.end = shot[1];
+
+        // The shot includes its last frame
+        size_t firstBin = static_cast<size_t>(std::floor(shot[0] / fps * envelope_rate));
+        size_t lastBin = std::min(bin_sum.size(),
+                                  static_cast<size_t>(std::ceil((shot[1] + 1) / fps * envelope_rate)));
+        double sum = 0.0;
+        uint64_t samples = 0;
+        float peak = 0.0f;
+        for (size_t i = firstBin; i < lastBin; ++i) {
+            sum += bin_sum[i];
+            samples += bin_count[i];
+            peak = std::max(peak, bin_peak[i]);
+        }
+        if (samples > 0) {
+            loudness.rmsDb = toDb(std::sqrt(sum / samples));
+            loudness.peakDb = toDb(peak);
+        }
+        analysis.shots.push_back(loudness);
+    }
+    return analysis;
+}
@@ -0,0 +1,96 @@
+#ifndef AUDIO_ANALYSIS_H
+#define AUDIO_ANALYSIS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswresample/swresample.h>
+}
+
+struct AudioOptions {
+    bool enabled = false;
+    int envelopeRate = 50;  // Envelope values per second
+};
+
+// Level reported for digital silence, in dBFS
+const float SILENCE_DB = -100.0f;
+
+// Unweighted loudness of the audio during one shot, in dBFS
+struct ShotLoudness {
+    int start = 0;
+    int end = 0;
+    float rmsDb = SILENCE_DB;
+    float peakDb = SILENCE_DB;
+};
+
+struct AudioAnalysis {
+    int sampleRate = 0;    // 0 if the video has no decodable audio
+    int channels = 0;
+    int envelopeRate = 0;
+    // Linear levels in [0, 1] per 1 / envelopeRate seconds, measured over all
+    // channels. Bin 0 starts with the first video frame.
+    std::vector<float> peak;
+    std::vector<float> rms;
+    std::vector<ShotLoudness> shots;
+};
+
+// Largest absolute value and sum of squares of count samples. Written with
+// independent lanes so the compiler can vectorize it without -ffast-math.
+void reduceSamples(const float* samples, size_t count, float& peak, float& sumSquares);
+
+// Decodes the packets of one audio stream and reduces them to an envelope
+// while the video is read, so no second pass over the file is needed
+class AudioAnalyzer {
+public:
+    AudioAnalyzer();
+    ~AudioAnalyzer();
+
+    AudioAnalyzer(const AudioAnalyzer&) = delete;
+    AudioAnalyzer& operator=(const AudioAnalyzer&) = delete;
+
+    // video_origin is the start time of the video stream in seconds
+    bool open(const AVStream* stream, const AudioOptions& options, double video_origin);
+    int streamIndex() const { return stream_index; }
+
+    // Clears the envelope for a new pass over the file
+    void reset();
+    // Returns a negative AVERROR if the packet could not be decoded
+    int addPacket(const AVPacket* packet);
+    // Drains the decoder at the end of the file
+    void flush();
+
+    // Envelope and the loudness of the given shots, which are frame ranges
+    AudioAnalysis result(const std::vector<std::vector<int>>& shots, double fps) const;
+
+private:
+    int receiveFrames();
+    void addFrame(const AVFrame* frame);
+    // Each plane holds count samples, starting at sample first
+    void addSamples(const float* const* samplePlanes, int planeCount, int interleaved, int64_t first, int count);
+
+    AVCodecContext* codec_ctx = nullptr;
+    SwrContext* swr_ctx = nullptr;
+    AVFrame* frame = nullptr;
+    std::vector<float> converted;  // Interleaved float samples for other sample formats
+    std::vector<const float*> plane_ptrs;
+    int swr_format = -1;
+    int swr_channels = 0;
+    int stream_index = -1;
+    int sample_rate = 0;
+    int channels = 0;
+    int envelope_rate = 0;
+    AVRational time_base = {0, 1};
+    double origin = 0.0;
+    int64_t position = -1;  // Next sample per channel relative to origin, -1 before the first frame
+    size_t expected_bins = 0;
+
+    std::vector<float> bin_peak;
+    std::vector<double> bin_sum;       // Sum of squares over all channels
+    std::vector<uint32_t> bin_count;   // Samples over all channels
+};
+
+#endif
@@ -0,0 +1,822 @@
+// Standalone benchmark for VideoReader. It encodes deterministic synthetic
+// clips with libavcodec and measures the operations used by the bindings.
+// Results are written as JSON so that runs on the same machine can be compared.
+//
+// With --check-allocations the benchmark also verifies that the steady state
+// of the decode loops does not allocate. With glibc malloc, calloc, realloc
+// and the aligned variants are replaced, so allocations made through
+// av_malloc, av_frame_alloc or av_packet_alloc are counted as well as
+// operator new; other C libraries only count operator new. The count of the
+// calling thread must not grow once the first progress report arrived (shot
+// detection, batch screenshots) or after a warm-up seek (single screenshots).
+// Allocations inside the stages that only call into FFmpeg, ONNX Runtime or
+// stdio, e.g. the buffer reference libavcodec creates for every decoded
+// frame, are reported per stage but not checked. The exit code is 1 otherwise.
+//
+// --model can be given several times, e.g. for the float32 model and a
+// variant made by quantize_model.py. Every model runs the shot detection on
+// every clip and is scored against the known cuts of the synthetic clips and
+// of the clips given with --labeled (a video and a text file listing the
+// first frame of every shot but the first). The summary holds precision,
+// recall and throughput per model.
+//
+// Usage: video_reader_benchmark [--model transnetv2.onnx]... [--workdir DIR]
+//                               [--output results.json] [--quick]
+//                               [--labeled video.mp4 cuts.txt]... [--tolerance N]
+//                               [--check-allocations]
+
+#include "video_reader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+}
+
+namespace {
+
+thread_local uint64_t threadAllocations = 0;
+
+uint64_t countThreadAllocations() {
+    return threadAllocations;
+}
+
+}  // namespace
+
+#if defined(__GLIBC__)
+// Defined in the executable, these replace the C library's allocator for
+// the statically linked FFmpeg and ONNX Runtime too. operator new ends up
+// in malloc and needs no hook of its own.
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* p);
+
+void* malloc(size_t size) noexcept {
+    threadAllocations++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept {
+    threadAllocations++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size) noexcept {
+    // realloc(p, 0) frees
+    if (size > 0) {
+        threadAllocations++;
+    }
+    return __libc_realloc(p, size);
+}
+
+void free(void* p) noexcept {
+    __libc_free(p);
+}
+
+void* memalign(size_t alignment, size_t size) noexcept {
+    threadAllocations++;
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept {
+    threadAllocations++;
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** out, size_t alignment, size_t size) noexcept {
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    threadAllocations++;
+    void* p = __libc_memalign(alignment, size);
+    if (!p) {
+        return ENOMEM;
+    }
+    *out = p;
+    return 0;
+}
+
+}  // extern "C"
+#else
+void* operator new(size_t size) {
+    threadAllocations++;
+    void* p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Transition { Hard, Gradual };
+
+struct ClipSpec {
+    std::string name;
+    AVCodecID codec;
+    std::string container;
+    int width;
+    int height;
+    int fps;
+    int gop;
+    int frames;
+    int sceneLength;
+    Transition transition;
+    int fadeLength;
+};
+
+struct LabeledClip {
+    std::string video;
+    std::string cuts;
+};
+
+struct Options {
+    std::vector<std::string> models;
+    std::vector<LabeledClip> labeled;
+    int tolerance = 2;  // Frames a detected cut of a labeled clip may be off
+    std::string workdir = "video_reader_benchmark";
+    std::string output;
+    bool quick = false;
+    bool checkAllocations = false;
+};
+
+// Cuts matched against the labels, summed over clips
+struct Accuracy {
+    uint64_t matched = 0;
+    uint64_t detected = 0;
+    uint64_t expected = 0;
+    uint64_t frames = 0;
+    double ms = 0.0;
+
+    void add(const Accuracy& other) {
+        matched += other.matched;
+        detected += other.detected;
+        expected += other.expected;
+        frames += other.frames;
+        ms += other.ms;
+    }
+
+    double precision() const { return detected ? static_cast<double>(matched) / detected : 1.0; }
+    double recall() const { return expected ? static_cast<double>(matched) / expected : 1.0; }
+    double f1() const {
+        double p = precision();
+        double r = recall();
+        return p + r > 0 ? 2 * p * r / (p + r) : 0.0;
+    }
+};
+
+struct RunState {
+    bool ok = true;
+    std::map<std::string, Accuracy> accuracy;
+};
+
+// Allocations of the calling thread after the first progress report,
+// excluding those made by the progress callback itself
+struct SteadyState {
+    bool started = false;
+    uint64_t startCount = 0;
+    uint64_t callbackCount = 0;
+    MetricsSnapshot start;
+    // State at the last progress report
+    uint64_t lastCount = 0;
+    uint64_t lastCallbackCount = 0;
+    MetricsSnapshot last;
+
+    ProgressCallback callback(VideoReader& reader) {
+        return [this, &reader](const ProgressInfo&) {
+            uint64_t before = countThreadAllocations();
+            if (!started) {
+                start = reader.getMetrics();
+                started = true;
+                startCount = countThreadAllocations();
+                lastCount = startCount;
+                last = start;
+                return;
+            }
+            lastCount = before;
+            lastCallbackCount = callbackCount;
+            last = reader.getMetrics();
+            callbackCount += countThreadAllocations() - before;
+        };
+    }
+
+    // Until the end of the run
+    uint64_t allocations() const {
+        return started ? countThreadAllocations() - startCount - callbackCount : 0;
+    }
+
+    // Until the last progress report, i.e. without the result built at the end
+    uint64_t reportedAllocations() const {
+        return lastCount - startCount - lastCallbackCount;
+    }
+};
+
+double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+double median(std::vector<double> values) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2.0;
+}
+
+std::vector<ClipSpec> clipSpecs(bool quick) {
+    int frames = quick ? 300 : 1500;
+    std::vector<ClipSpec> specs = {
+        {"mpeg4_480p_gop12_hard", AV_CODEC_ID_MPEG4, "mp4", 854, 480, 25, 12, frames, 75, Transition::Hard, 0},
+        {"mpeg4_1080p_gop250_hard", AV_CODEC_ID_MPEG4, "mp4", 1920, 1080, 25, 250, frames, 75, Transition::Hard, 0},
+        {"mpeg2_720p_gop15_gradual", AV_CODEC_ID_MPEG2VIDEO, "mp4", 1280, 720, 25, 15, frames, 100, Transition::Gradual, 20},
+        {"mjpeg_480p_intra_hard", AV_CODEC_ID_MJPEG, "matroska", 854, 480, 25, 1, frames, 75, Transition::Hard, 0},
+    };
+    if (quick) {
+        specs.erase(specs.begin() + 1);
+    }
+    return specs;
+}
+
+// Scene s gets its own pattern direction, speed and chroma so that cuts are
+// clearly visible while consecutive frames of a scene still differ.
+void drawScene(const ClipSpec& spec, int scene, int t, uint8_t* y, int yStride,
+               uint8_t* u, uint8_t* v, int cStride) {
+    int dx = 1 + (scene * 7) % 5;
+    int dy = 1 + (scene * 3) % 4;
+    int offset = scene * 53 + t * (2 + scene % 3);
+    for (int row = 0; row < spec.height; ++row) {
+        uint8_t* line = y + row * yStride;
+        for (int col = 0; col < spec.width; ++col) {
+            line[col] = static_cast<uint8_t>(((col * dx + row * dy) / 4 + offset) & 0xff);
+        }
+    }
+    uint8_t cb = static_cast<uint8_t>(64 + (scene * 97) % 128);
+    uint8_t cr = static_cast<uint8_t>(64 + (scene * 59) % 128);
+    for (int row = 0; row < spec.height / 2; ++row) {
+        memset(u + row * cStride, cb, spec.width / 2);
+        memset(v + row * cStride, cr, spec.width / 2);
+    }
+}
+
+void drawFrame(const ClipSpec& spec, int index, AVFrame* frame, std::vector<uint8_t>& scratch) {
+    int scene = index / spec.sceneLength;
+    int t = index % spec.sceneLength;
+    int fadeStart = spec.sceneLength - spec.fadeLength;
+    drawScene(spec, scene, t, frame->data[0], frame->linesize[0],
+              frame->data[1], frame->data[2], frame->linesize[1]);
+
+    if (spec.transition != Transition::Gradual || t < fadeStart) {
+        return;
+    }
+
+    // Cross-fade into the next scene
+    int lumaSize = spec.width * spec.height;
+    int chromaSize = lumaSize / 4;
+    int cStride = spec.width / 2;
+    scratch.resize(lumaSize + 2 * chromaSize);
+    uint8_t* y = scratch.data();
+    uint8_t* u = y + lumaSize;
+    uint8_t* v = u + chromaSize;
+    drawScene(spec, scene + 1, t - spec.sceneLength, y, spec.width, u, v, cStride);
+
+    int alpha = (t - fadeStart + 1) * 256 / (spec.fadeLength + 1);
+    for (int row = 0; row < spec.height; ++row) {
+        uint8_t* dst = frame->data[0] + row * frame->linesize[0];
+        const uint8_t* src = y + row * spec.width;
+        for (int col = 0; col < spec.width; ++col) {
+            dst[col] = static_cast<uint8_t>((dst[col] * (256 - alpha) + src[col] * alpha) >> 8);
+        }
+    }
+    for (int row = 0; row < spec.height / 2; ++row) {
+        uint8_t* dstU = frame->data[1] + row * frame->linesize[1];
+        uint8_t* dstV = frame->data[2] + row * frame->linesize[2];
+        const uint8_t* srcU = u + row * cStride;
+        const uint8_t* srcV = v + row * cStride;
+        for (int col = 0; col < spec.width / 2; ++col) {
+            dstU[col] = static_cast<uint8_t>((dstU[col] * (256 - alpha) + srcU[col] * alpha) >> 8);
+            dstV[col] = static_cast<uint8_t>((dstV[col] * (256 - alpha) + srcV[col] * alpha) >> 8);
+        }
+    }
+}
+
+int writePackets(AVCodecContext* enc, AVFormatContext* fmt, AVStream* stream, AVPacket* pkt) {
+    int ret;
+    while ((ret = avcodec_receive_packet(enc, pkt)) == 0) {
+        av_packet_rescale_ts(pkt, enc->time_base, stream->time_base);
+        pkt->stream_index = stream->index;
+        if ((ret = av_interleaved_write_frame(fmt, pkt)) < 0) {
+            return ret;
+        }
+    }
+    return (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) ? 0 : ret;
+}
+
+bool generateClip(const ClipSpec& spec, const std::string& path) {
+    const AVCodec* codec = avcodec_find_encoder(spec.codec);
+    if (!codec) {
+        std::cerr << "Encoder not available for " << spec.name << std::endl;
+        return false;
+    }
+
+    AVFormatContext* fmt = nullptr;
+    if (avformat_alloc_output_context2(&fmt, nullptr, spec.container.c_str(), path.c_str()) < 0) {
+        return false;
+    }
+
+    AVCodecContext* enc = avcodec_alloc_context3(codec);
+    AVStream* stream = avformat_new_stream(fmt, nullptr);
+    AVFrame* frame = av_frame_alloc();
+    AVPacket* pkt = av_packet_alloc();
+    std::vector<uint8_t> scratch;
+    bool ok = enc && stream && frame && pkt;
+
+    if (ok) {
+        enc->width = spec.width;
+        enc->height = spec.height;
+        enc->pix_fmt = spec.codec == AV_CODEC_ID_MJPEG ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_YUV420P;
+        enc->time_base = AVRational{1, spec.fps};
+        enc->framerate = AVRational{spec.fps, 1};
+        enc->gop_size = spec.gop;
+        enc->max_b_frames = 0;
+        enc->bit_rate = static_cast<int64_t>(spec.width) * spec.height * 4;
+        enc->thread_count = 0;
+        enc->strict_std_compliance = FF_COMPLIANCE_UNOFFICIAL;
+        if (fmt->oformat->flags & AVFMT_GLOBALHEADER) {
+            enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+        ok = avcodec_open2(enc, codec, nullptr) >= 0 &&
+             avcodec_parameters_from_context(stream->codecpar, enc) >= 0;
+    }
+
+    if (ok) {
+        stream->time_base = enc->time_base;
+        stream->avg_frame_rate = enc->framerate;
+        stream->r_frame_rate = enc->framerate;
+        ok = avio_open(&fmt->pb, path.c_str(), AVIO_FLAG_WRITE) >= 0 &&
+             avformat_write_header(fmt, nullptr) >= 0;
+    }
+
+    if (ok) {
+        frame->format = enc->pix_fmt;
+        frame->width = spec.width;
+        frame->height = spec.height;
+        ok = av_frame_get_buffer(frame, 0) >= 0;
+    }
+
+    for (int i = 0; ok && i < spec.frames; ++i) {
+        ok = av_frame_make_writable(frame) >= 0;
+        drawFrame(spec, i, frame, scratch);
+        frame->pts = i;
+        ok = ok && avcodec_send_frame(enc, frame) >= 0 &&
+             writePackets(enc, fmt, stream, pkt) >= 0;
+    }
+
+    if (ok) {
+        ok = avcodec_send_frame(enc, nullptr) >= 0 &&
+             writePackets(enc, fmt, stream, pkt) >= 0 &&
+             av_write_trailer(fmt) >= 0;
+    }
+
+    if (fmt && fmt->pb) {
+        avio_closep(&fmt->pb);
+    }
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&enc);
+    avformat_free_context(fmt);
+    return ok;
+}
+
+// Frames at which the synthetic clip changes scene
+std::vector<int> expectedCuts(const ClipSpec& spec) {
+    std::vector<int> cuts;
+    for (int f = spec.sceneLength; f < spec.frames; f += spec.sceneLength) {
+        cuts.push_back(f);
+    }
+    return cuts;
+}
+
+// Cuts of a labeled clip, one frame number per line or separated by spaces
+bool readCuts(const std::string& path, std::vector<int>& cuts) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    int frame;
+    while (file >> frame) {
+        cuts.push_back(frame);
+    }
+    std::sort(cuts.begin(), cuts.end());
+    return file.eof();
+}
+
+// Matches every expected cut with the closest unmatched detected cut
+Accuracy scoreShots(const std::vector<std::vector<int>>& shots, const std::vector<int>& cuts, int tolerance) {
+    std::vector<int> detected;
+    for (size_t i = 1; i < shots.size(); ++i) {
+        detected.push_back(shots[i][0]);
+    }
+    std::vector<bool> used(detected.size(), false);
+
+    Accuracy accuracy;
+    accuracy.detected = detected.size();
+    accuracy.expected = cuts.size();
+    for (int cut : cuts) {
+        int best = -1;
+        for (size_t i = 0; i < detected.size(); ++i) {
+            int distance = std::abs(detected[i] - cut);
+            if (!used[i] && distance <= tolerance && (best < 0 || distance < std::abs(detected[best] - cut))) {
+                best = static_cast<int>(i);
+            }
+        }
+        if (best >= 0) {
+            used[best] = true;
+            accuracy.matched++;
+        }
+    }
+    return accuracy;
+}
+
+std::string modelName(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+std::string stagesJson(const MetricsSnapshot& snapshot) {
+    std::ostringstream out;
+    out << "{";
+    bool first = true;
+    for (const StageStats& stage : snapshot.stages) {
+        if (stage.count == 0) {
+            continue;
+        }
+        out << (first ? "" : ",") << "\"" << stage.name << "\":{\"count\":" << stage.count
+            << ",\"total_ms\":" << stage.totalMs << ",\"max_ms\":" << stage.maxMs << "}";
+        first = false;
+    }
+    out << "}";
+    return out.str();
+}
+
+// Stages that only wrap calls into FFmpeg, ONNX Runtime or stdio, whose
+// allocations the reader cannot avoid
+bool libraryStage(Stage stage) {
+    switch (stage) {
+        case Stage::Demux:
+        case Stage::PacketSend:
+        case Stage::Decode:
+        case Stage::Inference:
+        case Stage::JpegEncode:
+        case Stage::FileWrite:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Allocations of a thread between two snapshots outside the library stages
+uint64_t ownAllocations(uint64_t total, const MetricsSnapshot& start, const MetricsSnapshot& end) {
+    uint64_t library = 0;
+    for (size_t i = 0; i < end.stages.size(); ++i) {
+        if (libraryStage(static_cast<Stage>(i))) {
+            library += end.stages[i].allocations - start.stages[i].allocations;
+        }
+    }
+    return total > library ? total - library : 0;
+}
+
+// Allocations per stage between two snapshots, to see where a failing
+// check allocated
+std::string stageAllocationsJson(const MetricsSnapshot& start, const MetricsSnapshot& end) {
+    std::ostringstream out;
+    out << "{";
+    for (size_t i = 0; i < end.stages.size(); ++i) {
+        uint64_t delta = end.stages[i].allocations - start.stages[i].allocations;
+        out << (i == 0 ? "" : ",") << "\"" << end.stages[i].name << "\":" << delta;
+    }
+    out << "}";
+    return out.str();
+}
+
+std::string ioJson(const MetricsSnapshot& snapshot) {
+    std::ostringstream out;
+    out << "{\"bytes_read\":" << snapshot.io.bytesRead << ",\"bytes_consumed\":" << snapshot.io.bytesConsumed
+        << ",\"reads\":" << snapshot.io.reads << ",\"seeks\":" << snapshot.io.seeks << "}";
+    return out.str();
+}
+
+// Runs every model on the clip and scores the shots against the cuts
+std::string detectShotsJson(const std::string& path, const std::vector<int>& cuts, int tolerance,
+                            const Options& options, RunState& state) {
+    std::ostringstream out;
+    out << "{";
+    double baselineFps = 0.0;
+    for (size_t m = 0; m < options.models.size(); ++m) {
+        const std::string& model = options.models[m];
+        VideoReader reader(path);
+        reader.Open();
+        Clock::time_point start = Clock::now();
+        std::vector<std::vector<int>> shots = reader.DetectShots(model);
+        double ms = elapsedMs(start);
+
+        Accuracy accuracy = scoreShots(shots, cuts, tolerance);
+        accuracy.frames = shots.empty() ? 0 : shots.back()[1];
+        accuracy.ms = ms;
+        state.accuracy[modelName(model)].add(accuracy);
+
+        double fps = accuracy.frames * 1000.0 / ms;
+        if (m == 0) {
+            baselineFps = fps;
+        }
+        out << (m == 0 ? "" : ",") << jsonString(modelName(model)) << ":{\"ms\":" << ms << ",\"fps\":" << fps
+            << ",\"speedup\":" << (baselineFps > 0 ? fps / baselineFps : 0.0)
+            << ",\"shots\":" << shots.size() << ",\"expected_shots\":" << cuts.size() + 1
+            << ",\"precision\":" << accuracy.precision() << ",\"recall\":" << accuracy.recall()
+            << ",\"f1\":" << accuracy.f1()
+            << ",\"stages\":" << stagesJson(reader.getMetrics()) << "}";
+    }
+    out << "}";
+    return out.str();
+}
+
+std::string checkAllocations(const ClipSpec& spec, const std::string& path,
+                             const std::string& screenshotDir, const Options& options, bool& ok) {
+    std::ostringstream out;
+    out << "{";
+
+    if (!options.models.empty()) {
+        VideoReader reader(path);
+        reader.Open();
+        SteadyState steady;
+        reader.DetectShots(options.models.front(), steady.callback(reader));
+        if (steady.started) {
+            // The returned shot vectors are built after the loop and left out
+            uint64_t allocations = ownAllocations(steady.reportedAllocations(), steady.start, steady.last);
+            out << "\"detect_shots\":{\"total\":" << allocations
+                << ",\"stages\":" << stageAllocationsJson(steady.start, steady.last) << "},";
+            if (allocations > 0) {
+                std::cerr << "Allocations in steady state of DetectShots: " << allocations << std::endl;
+                ok = false;
+            }
+        }
+    }
+
+    {
+        VideoReader reader(path);
+        reader.Open();
+        std::vector<int> frames;
+        for (int f = 0; f < spec.frames; f += spec.fps) {
+            frames.push_back(f);
+        }
+        SteadyState steady;
+        reader.generateScreenshots(screenshotDir, frames, steady.callback(reader));
+        if (steady.started) {
+            uint64_t total = steady.allocations();
+            MetricsSnapshot end = reader.getMetrics();
+            uint64_t allocations = ownAllocations(total, steady.start, end);
+            out << "\"screenshots\":{\"total\":" << allocations
+                << ",\"stages\":" << stageAllocationsJson(steady.start, end) << "},";
+            if (allocations > 0) {
+                std::cerr << "Allocations in steady state of generateScreenshots: " << allocations << std::endl;
+                ok = false;
+            }
+        }
+    }
+
+    {
+        VideoReader reader(path);
+        reader.Open();
+        reader.generateScreenshot(screenshotDir, spec.frames / 2);
+        MetricsSnapshot start = reader.getMetrics();
+        uint64_t before = countThreadAllocations();
+        for (int target = 0; target < spec.frames; target += spec.frames / 5) {
+            reader.generateScreenshot(screenshotDir, target);
+        }
+        uint64_t total = countThreadAllocations() - before;
+        MetricsSnapshot end = reader.getMetrics();
+        uint64_t allocations = ownAllocations(total, start, end);
+        out << "\"screenshot_seek\":{\"total\":" << allocations
+            << ",\"stages\":" << stageAllocationsJson(start, end) << "}";
+        if (allocations > 0) {
+            std::cerr << "Allocations in repeated generateScreenshot: " << allocations << std::endl;
+            ok = false;
+        }
+    }
+
+    out << "}";
+    return out.str();
+}
+
+std::string benchmarkClip(const ClipSpec& spec, const std::string& path,
+                          const std::string& screenshotDir, const Options& options, RunState& state) {
+    std::ostringstream out;
+    out << "{\"name\":\"" << spec.name << "\",\"codec\":\"" << avcodec_get_name(spec.codec)
+        << "\",\"width\":" << spec.width << ",\"height\":" << spec.height
+        << ",\"fps\":" << spec.fps << ",\"gop\":" << spec.gop << ",\"frames\":" << spec.frames
+        << ",\"transition\":\"" << (spec.transition == Transition::Hard ? "hard" : "gradual") << "\"";
+
+    // Open latency
+    int openRuns = options.quick ? 3 : 10;
+    std::vector<double> openTimes;
+    for (int i = 0; i < openRuns; ++i) {
+        Clock::time_point start = Clock::now();
+        VideoReader reader(path);
+        if (!reader.Open()) {
+            out << ",\"error\":\"open failed\"}";
+            return out.str();
+        }
+        openTimes.push_back(elapsedMs(start));
+    }
+    out << ",\"open_ms\":" << median(openTimes);
+
+    // Shot detection throughput and accuracy, cross-fades may be detected anywhere in the fade
+    if (!options.models.empty()) {
+        out << ",\"detect_shots\":"
+            << detectShotsJson(path, expectedCuts(spec), std::max(2, spec.fadeLength), options, state);
+    }
+
+    // Single screenshot seek latency at deterministic positions
+    {
+        VideoReader reader(path);
+        reader.Open();
+        int seeks = options.quick ? 5 : 20;
+        uint32_t lcg = 12345;
+        std::vector<double> seekTimes;
+        for (int i = 0; i < seeks; ++i) {
+            lcg = lcg * 1664525u + 1013904223u;
+            int target = static_cast<int>(lcg % spec.frames);
+            Clock::time_point start = Clock::now();
+            reader.generateScreenshot(screenshotDir, target);
+            seekTimes.push_back(elapsedMs(start));
+        }
+        std::sort(seekTimes.begin(), seekTimes.end());
+        out << ",\"screenshot_seek\":{\"median_ms\":" << median(seekTimes)
+            << ",\"max_ms\":" << seekTimes.back() << ",\"io\":" << ioJson(reader.getMetrics()) << "}";
+    }
+
+    // Batch screenshot throughput, one screenshot per second of video
+    {
+        VideoReader reader(path);
+        reader.Open();
+        std::vector<int> frames;
+        for (int f = 0; f < spec.frames; f += spec.fps) {
+            frames.push_back(f);
+        }
+        Clock::time_point start = Clock::now();
+        reader.generateScreenshots(screenshotDir, frames);
+        double ms = elapsedMs(start);
+        out << ",\"screenshots\":{\"count\":" << frames.size() << ",\"ms\":" << ms
+            << ",\"per_second\":" << frames.size() * 1000.0 / ms
+            << ",\"decode_fps\":" << spec.frames * 1000.0 / ms
+            << ",\"stages\":" << stagesJson(reader.getMetrics())
+            << ",\"io\":" << ioJson(reader.getMetrics()) << "}";
+    }
+
+    if (options.checkAllocations) {
+        out << ",\"allocation_check\":" << checkAllocations(spec, path, screenshotDir, options, state.ok);
+    }
+
+    out << "}";
+    return out.str();
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--model" && i + 1 < argc) {
+            options.models.push_back(argv[++i]);
+        } else if (arg == "--labeled" && i + 2 < argc) {
+            options.labeled.push_back({argv[i + 1], argv[i + 2]});
+            i += 2;
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            options.tolerance = atoi(argv[++i]);
+        } else if (arg == "--workdir" && i + 1 < argc) {
+            options.workdir = argv[++i];
+        } else if (arg == "--output" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (arg == "--quick") {
+            options.quick = true;
+        } else if (arg == "--check-allocations") {
+            options.checkAllocations = true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--model transnetv2.onnx]... [--workdir DIR] [--output results.json] [--quick]"
+                  << " [--labeled video.mp4 cuts.txt]... [--tolerance N] [--check-allocations]" << std::endl;
+        return 2;
+    }
+
+    if (options.checkAllocations) {
+        Metrics::setAllocationCounter(countThreadAllocations);
+    }
+
+    std::string screenshotDir = options.workdir + "/screenshots";
+    mkdir(options.workdir.c_str(), 0755);
+    mkdir(screenshotDir.c_str(), 0755);
+
+    std::ostringstream json;
+    json << "{\"quick\":" << (options.quick ? "true" : "false") << ",\"clips\":[";
+    bool first = true;
+    RunState state;
+    for (const ClipSpec& spec : clipSpecs(options.quick)) {
+        std::string path = options.workdir + "/" + spec.name +
+                           (spec.container == "matroska" ? ".mkv" : ".mp4");
+        std::cerr << "Generating " << path << std::endl;
+        if (!generateClip(spec, path)) {
+            std::cerr << "Skipping " << spec.name << ", clip could not be generated" << std::endl;
+            continue;
+        }
+        std::cerr << "Benchmarking " << spec.name << std::endl;
+        json << (first ? "" : ",") << "\n" << benchmarkClip(spec, path, screenshotDir, options, state);
+        first = false;
+    }
+    json << "\n]";
+
+    if (!options.models.empty() && !options.labeled.empty()) {
+        json << ",\"labeled\":[";
+        first = true;
+        for (const LabeledClip& clip : options.labeled) {
+            std::vector<int> cuts;
+            if (!readCuts(clip.cuts, cuts)) {
+                std::cerr << "Skipping " << clip.video << ", cannot read " << clip.cuts << std::endl;
+                continue;
+            }
+            std::cerr << "Detecting shots in " << clip.video << std::endl;
+            json << (first ? "" : ",") << "\n{\"video\":" << jsonString(clip.video) << ",\"detect_shots\":"
+                 << detectShotsJson(clip.video, cuts, options.tolerance, options, state) << "}";
+            first = false;
+        }
+        json << "\n]";
+    }
+
+    if (!state.accuracy.empty()) {
+        json << ",\"models\":{";
+        first = true;
+        for (const std::string& model : options.models) {
+            const Accuracy& accuracy = state.accuracy[modelName(model)];
+            json << (first ? "" : ",") << "\n" << jsonString(modelName(model)) << ":{\"precision\":" << accuracy.precision()
+                 << ",\"recall\":" << accuracy.recall() << ",\"f1\":" << accuracy.f1()
+                 << ",\"fps\":" << (accuracy.ms > 0 ? accuracy.frames * 1000.0 / accuracy.ms : 0.0) << "}";
+            first = false;
+        }
+        json << "}";
+    }
+    if (options.checkAllocations) {
+        json << ",\"allocation_check_passed\":" << (state.ok ? "true" : "false");
+    }
+    json << "}\n";
+
+    if (options.output.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream file(options.output);
+        file << json.str();
+        if (!file) {
+            std::cerr << "Failed to write " << options.output << std::endl;
+            return 1;
+        }
+    }
+    return state.ok ? 0 : 1;
+}
@@ -0,0 +1,479 @@
+#include "media_io.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <sys/mount.h>
+#include <sys/param.h>
+#else
+#include <sys/vfs.h>
+#endif
+#endif
+
+namespace {
+
+const size_t MMAP_AVIO_BUFFER_SIZE = 64 * 1024;
+
+int64_t fileTell(FILE* file) {
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return ftello(file);
+#endif
+}
+
+int fileSeek(FILE* file, int64_t offset, int whence) {
+#ifdef _WIN32
+    return _fseeki64(file, offset, whence);
+#else
+    return fseeko(file, offset, whence);
+#endif
+}
+
+// Maps the whole file read-only and copies from the mapping on every read
+class MmapSource : public MediaSource {
+public:
+    ~MmapSource() override {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (data) munmap(const_cast<uint8_t*>(data), file_size);
+#endif
+    }
+
+    bool open(const std::string& path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            return false;
+        }
+        file_size = fileSize.QuadPart;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            return false;
+        }
+        data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!data) {
+            return false;
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return false;
+        }
+        file_size = st.st_size;
+        void* mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        data = static_cast<const uint8_t*>(mapped);
+#endif
+        return createContext(MMAP_AVIO_BUFFER_SIZE);
+    }
+
+protected:
+    int read(uint8_t* buf, int size) override {
+        if (pos >= file_size) {
+            return AVERROR_EOF;
+        }
+        int n = static_cast<int>(std::min<int64_t>(size, file_size - pos));
+        memcpy(buf, data + pos, n);
+        pos += n;
+        bytes_read += n;
+        reads++;
+        return n;
+    }
+
+    int64_t seek(int64_t offset) override {
+        if (offset < 0 || offset > file_size) {
+            return AVERROR(EINVAL);
+        }
+        pos = offset;
+        return pos;
+    }
+
+    int64_t size() const override { return file_size; }
+    int64_t position() const override { return pos; }
+
+private:
+    const uint8_t* data = nullptr;
+    int64_t file_size = 0;
+    int64_t pos = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+// Reads large blocks and keeps the next blocks in flight on a background
+// thread, so that the high latency of network mounts is paid only once per
+// block instead of once per small demuxer read.
+class BufferedSource : public MediaSource {
+public:
+    BufferedSource(size_t blockSize, int readAhead)
+        : block_size(std::max<size_t>(blockSize, 4096)), read_ahead(std::max(readAhead, 0)) {}
+
+    ~BufferedSource() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        work_cv.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    bool open(const std::string& path) {
+        file = fopen(path.c_str(), "rb");
+        if (!file || fileSeek(file, 0, SEEK_END) != 0) {
+            return false;
+        }
+        file_size = fileTell(file);
+        if (file_size <= 0 || !createContext(block_size)) {
+            return false;
+        }
+        if (read_ahead > 0) {
+            worker = std::thread(&BufferedSource::readAheadLoop, this);
+        }
+        return true;
+    }
+
+protected:
+    int read(uint8_t* buf, int size) override {
+        if (pos >= file_size) {
+            return AVERROR_EOF;
+        }
+
+        int64_t index = pos / static_cast<int64_t>(block_size);
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = blocks.find(index);
+        while (it == blocks.end()) {
+            if (inflight.count(index)) {
+                block_ready.wait(lock);
+            } else {
+                inflight.insert(index);
+                lock.unlock();
+                std::vector<uint8_t> block;
+                bool ok = fetch(index, block);
+                lock.lock();
+                inflight.erase(index);
+                if (!ok) {
+                    // Not cached, the next read tries the block again
+                    block_ready.notify_all();
+                    return AVERROR(EIO);
+                }
+                blocks[index] = std::move(block);
+                block_ready.notify_all();
+            }
+            it = blocks.find(index);
+        }
+
+        const std::vector<uint8_t>& block = it->second;
+        size_t offset = static_cast<size_t>(pos - index * static_cast<int64_t>(block_size));
+        if (offset >= block.size()) {
+            return AVERROR_EOF;
+        }
+        int n = static_cast<int>(std::min<size_t>(size, block.size() - offset));
+        memcpy(buf, block.data() + offset, n);
+        pos += n;
+
+        current_block = index;
+        evict();
+        scheduleReadAhead(index);
+        lock.unlock();
+        work_cv.notify_one();
+        return n;
+    }
+
+    int64_t seek(int64_t offset) override {
+        if (offset < 0 || offset > file_size) {
+            return AVERROR(EINVAL);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        int64_t index = offset / static_cast<int64_t>(block_size);
+        if (index != current_block) {
+            // Drop pending read-ahead of the old position
+            requests.clear();
+        }
+        pos = offset;
+        return pos;
+    }
+
+    int64_t size() const override { return file_size; }
+    int64_t position() const override { return pos; }
+
+private:
+    // Reads a whole block, false on errors or if the file got shorter
+    bool fetch(int64_t index, std::vector<uint8_t>& block) {
+        int64_t offset = index * static_cast<int64_t>(block_size);
+        size_t length = static_cast<size_t>(std::min<int64_t>(block_size, file_size - offset));
+        block.resize(length);
+
+        std::lock_guard<std::mutex> lock(file_mutex);
+        size_t n = 0;
+        if (fileSeek(file, offset, SEEK_SET) == 0) {
+            n = fread(block.data(), 1, length, file);
+        }
+        if (n != length) {
+            clearerr(file);
+            return false;
+        }
+        bytes_read += n;
+        reads++;
+        return true;
+    }
+
+    // Called with mutex held
+    void scheduleReadAhead(int64_t index) {
+        for (int64_t next = index + 1; next <= index + read_ahead; ++next) {
+            if (next * static_cast<int64_t>(block_size) >= file_size) {
+                break;
+            }
+            if (blocks.count(next) || inflight.count(next) ||
+                std::find(requests.begin(), requests.end(), next) != requests.end()) {
+                continue;
+            }
+            requests.push_back(next);
+        }
+    }
+
+    // Called with mutex held, keeps the previous block for small backward seeks
+    void evict() {
+        for (auto it = blocks.begin(); it != blocks.end();) {
+            if (it->first < current_block - 1 || it->first > current_block + read_ahead) {
+                it = blocks.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void readAheadLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            work_cv.wait(lock, [this] { return stopping || !requests.empty(); });
+            if (stopping) {
+                return;
+            }
+
+            int64_t index = requests.front();
+            requests.pop_front();
+            if (blocks.count(index) || inflight.count(index) || index <= current_block) {
+                continue;
+            }
+
+            inflight.insert(index);
+            lock.unlock();
+            std::vector<uint8_t> block;
+            bool ok = fetch(index, block);
+            lock.lock();
+            inflight.erase(index);
+            if (ok && index > current_block && index <= current_block + read_ahead) {
+                blocks[index] = std::move(block);
+            }
+            block_ready.notify_all();
+        }
+    }
+
+    size_t block_size;
+    int read_ahead;
+    FILE* file = nullptr;
+    int64_t file_size = 0;
+    int64_t pos = 0;
+
+    std::mutex file_mutex;
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable block_ready;
+    std::map<int64_t, std::vector<uint8_t>> blocks;
+    std::set<int64_t> inflight;
+    std::deque<int64_t> requests;
+    int64_t current_block = -1;
+    bool stopping = false;
+    std::thread worker;
+};
+
+}  // namespace
+
+bool parseIoMode(const std::string& name, IoMode& mode) {
+    if (name == "auto") {
+        mode = IoMode::Auto;
+    } else if (name == "ffmpeg") {
+        mode = IoMode::Ffmpeg;
+    } else if (name == "mmap") {
+        mode = IoMode::Mmap;
+    } else if (name == "buffered") {
+        mode = IoMode::Buffered;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+MediaSource::~MediaSource() {
+    if (avio_ctx) {
+        av_freep(&avio_ctx->buffer);
+        avio_context_free(&avio_ctx);
+    }
+}
+
+bool MediaSource::isNetworkPath(const std::string& path) {
+#ifdef _WIN32
+    if (path.compare(0, 2, "\\\\") == 0 || path.compare(0, 2, "//") == 0) {
+        return true;
+    }
+    if (path.size() >= 2 && path[1] == ':') {
+        std::string root = path.substr(0, 2) + "\\";
+        return GetDriveTypeA(root.c_str()) == DRIVE_REMOTE;
+    }
+    return false;
+#elif defined(__APPLE__)
+    struct statfs fs;
+    if (statfs(path.c_str(), &fs) != 0) {
+        return false;
+    }
+    const char* remote[] = {"nfs", "smbfs", "afpfs", "webdav", "cifs"};
+    for (const char* name : remote) {
+        if (strcmp(fs.f_fstypename, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+#else
+    struct statfs fs;
+    if (statfs(path.c_str(), &fs) != 0) {
+        return false;
+    }
+    switch (static_cast<uint32_t>(fs.f_type)) {
+        case 0x6969:      // NFS
+        case 0x517B:      // SMB
+        case 0xFF534D42:  // CIFS
+        case 0xFE534D42:  // SMB2
+        case 0x65735546:  // FUSE, e.g. sshfs
+            return true;
+        default:
+            return false;
+    }
+#endif
+}
+
+std::unique_ptr<MediaSource> MediaSource::open(const std::string& path, const IoOptions& options) {
+    IoMode mode = options.mode;
+    if (mode == IoMode::Auto) {
+        // Local files keep FFmpeg's I/O, which turns a file truncated while
+        // it is read, e.g. by a copy in progress, into a read error
+        mode = isNetworkPath(path) ? IoMode::Buffered : IoMode::Ffmpeg;
+    }
+
+    if (mode == IoMode::Mmap) {
+        std::unique_ptr<MmapSource> source(new MmapSource());
+        if (source->open(path)) {
+            return std::move(source);
+        }
+    } else if (mode == IoMode::Buffered) {
+        std::unique_ptr<BufferedSource> source(new BufferedSource(options.blockSize, options.readAhead));
+        if (source->open(path)) {
+            return std::move(source);
+        }
+    }
+    return nullptr;
+}
+
+bool MediaSource::createContext(size_t bufferSize) {
+    unsigned char* buffer = static_cast<unsigned char*>(av_malloc(bufferSize));
+    if (!buffer) {
+        return false;
+    }
+    avio_ctx = avio_alloc_context(buffer, static_cast<int>(bufferSize), 0, this,
+                                  &MediaSource::readPacket, nullptr, &MediaSource::seekCallback);
+    if (!avio_ctx) {
+        av_free(buffer);
+        return false;
+    }
+    return true;
+}
+
+IoStats MediaSource::stats() const {
+    IoStats result;
+    result.bytesRead = bytes_read;
+    result.bytesConsumed = bytes_consumed;
+    result.reads = reads;
+    result.seeks = seeks;
+    return result;
+}
+
+void MediaSource::resetStats() {
+    bytes_read = 0;
+    bytes_consumed = 0;
+    reads = 0;
+    seeks = 0;
+}
+
+int MediaSource::readPacket(void* opaque, uint8_t* buf, int size) {
+    MediaSource* source = static_cast<MediaSource*>(opaque);
+    int n = source->read(buf, size);
+    if (n > 0) {
+        source->bytes_consumed += n;
+    }
+    return n;
+}
+
+int64_t MediaSource::seekCallback(void* opaque, int64_t offset, int whence) {
+    MediaSource* source = static_cast<MediaSource*>(opaque);
+    whence &= ~AVSEEK_FORCE;
+    switch (whence) {
+        case AVSEEK_SIZE:
+            return source->size();
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            offset += source->position();
+            break;
+        case SEEK_END:
+            offset += source->size();
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    source->seeks++;
+    return source->seek(offset);
+}
@@ -0,0 +1,67 @@
+#ifndef MEDIA_IO_H
+#define MEDIA_IO_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "metrics.h"
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+enum class IoMode {
+    Auto,      // Buffered for network mounts, Ffmpeg otherwise
+    Ffmpeg,    // FFmpeg's own file protocol, no byte counters
+    Mmap,      // Opt-in only: a file that shrinks while mapped raises SIGBUS
+    Buffered
+};
+
+struct IoOptions {
+    IoMode mode = IoMode::Auto;
+    size_t blockSize = 1 << 20;  // Buffered mode: size of one read from storage
+    int readAhead = 4;           // Buffered mode: blocks fetched in the background
+};
+
+// Parses "auto", "ffmpeg", "mmap" and "buffered", returns false otherwise
+bool parseIoMode(const std::string& name, IoMode& mode);
+
+// Byte source behind a custom AVIOContext. The context stays owned by the
+// source and has to outlive the AVFormatContext using it.
+class MediaSource {
+public:
+    virtual ~MediaSource();
+
+    // Returns nullptr if the mode is Ffmpeg or the file cannot be opened with
+    // the requested mode, in which case FFmpeg's default I/O should be used.
+    static std::unique_ptr<MediaSource> open(const std::string& path, const IoOptions& options);
+    static bool isNetworkPath(const std::string& path);
+
+    AVIOContext* context() const { return avio_ctx; }
+    IoStats stats() const;
+    void resetStats();
+
+protected:
+    MediaSource() = default;
+    bool createContext(size_t bufferSize);
+
+    virtual int read(uint8_t* buf, int size) = 0;
+    virtual int64_t seek(int64_t offset) = 0;
+    virtual int64_t size() const = 0;
+    virtual int64_t position() const = 0;
+
+    std::atomic<uint64_t> bytes_read{0};      // Bytes read from storage
+    std::atomic<uint64_t> bytes_consumed{0};  // Bytes handed to the demuxer
+    std::atomic<uint64_t> reads{0};
+    std::atomic<uint64_t> seeks{0};
+
+private:
+    static int readPacket(void* opaque, uint8_t* buf, int size);
+    static int64_t seekCallback(void* opaque, int64_t offset, int whence);
+
+    AVIOContext* avio_ctx = nullptr;
+};
+
+#endif
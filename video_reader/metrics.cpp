@@ -0,0 +1,203 @@
+#include "metrics.h"
+
+#include <cstdio>
+
+namespace {
+
+const char* const STAGE_NAMES[] = {
+    "demux",
+    "packet_send",
+    "decode",
+    "scale",
+    "tensor_prep",
+    "inference",
+    "jpeg_encode",
+    "file_write",
+    "audio",
+    "tone_map",
+};
+
+const char* const QUEUE_NAMES[] = {
+    "frame_window",
+};
+
+int histogramBucket(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    int bucket = 0;
+    while (us > 0 && bucket < Metrics::HISTOGRAM_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void updateMin(std::atomic<uint64_t>& target, uint64_t value) {
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (value < current &&
+           !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void updateMax(std::atomic<uint64_t>& target, uint64_t value) {
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (value > current &&
+           !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+}  // namespace
+
+const char* stageName(Stage stage) {
+    return STAGE_NAMES[static_cast<size_t>(stage)];
+}
+
+const char* queueName(Queue queue) {
+    return QUEUE_NAMES[static_cast<size_t>(queue)];
+}
+
+std::string jsonString(const std::string& value) {
+    std::string out = "\"";
+    for (char c : value) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+std::atomic<Metrics::AllocationCounter> Metrics::allocationCounter{nullptr};
+
+Metrics::Metrics() : traceStart(Clock::now()) {
+    reset();
+}
+
+void Metrics::setAllocationCounter(AllocationCounter counter) {
+    allocationCounter.store(counter);
+}
+
+uint64_t Metrics::allocationCount() {
+    AllocationCounter counter = allocationCounter.load(std::memory_order_relaxed);
+    return counter ? counter() : 0;
+}
+
+void Metrics::record(Stage stage, Clock::time_point start, Clock::time_point end, uint64_t allocations) {
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    StageCounters& counters = stages[static_cast<size_t>(stage)];
+
+    counters.count.fetch_add(1, std::memory_order_relaxed);
+    counters.totalNs.fetch_add(ns, std::memory_order_relaxed);
+    updateMin(counters.minNs, ns);
+    updateMax(counters.maxNs, ns);
+    counters.allocations.fetch_add(allocations, std::memory_order_relaxed);
+    counters.histogram[histogramBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+
+    if (tracing.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        if (traceEvents.size() < MAX_TRACE_EVENTS) {
+            traceEvents.push_back({
+                stage,
+                std::chrono::duration_cast<std::chrono::microseconds>(start - traceStart).count(),
+                static_cast<int64_t>(ns / 1000)
+            });
+        }
+    }
+}
+
+void Metrics::setQueueDepth(Queue queue, uint64_t depth) {
+    QueueCounters& counters = queues[static_cast<size_t>(queue)];
+    counters.depth.store(depth, std::memory_order_relaxed);
+    updateMax(counters.maxDepth, depth);
+}
+
+MetricsSnapshot Metrics::snapshot() const {
+    MetricsSnapshot result;
+
+    for (size_t i = 0; i < stages.size(); ++i) {
+        const StageCounters& counters = stages[i];
+        StageStats stats;
+        stats.name = STAGE_NAMES[i];
+        stats.count = counters.count.load(std::memory_order_relaxed);
+        stats.totalMs = counters.totalNs.load(std::memory_order_relaxed) / 1e6;
+        if (stats.count > 0) {
+            stats.minMs = counters.minNs.load(std::memory_order_relaxed) / 1e6;
+            stats.maxMs = counters.maxNs.load(std::memory_order_relaxed) / 1e6;
+        }
+        stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+        for (const auto& bucket : counters.histogram) {
+            stats.histogram.push_back(bucket.load(std::memory_order_relaxed));
+        }
+        result.stages.push_back(stats);
+    }
+
+    for (size_t i = 0; i < queues.size(); ++i) {
+        QueueStats stats;
+        stats.name = QUEUE_NAMES[i];
+        stats.depth = queues[i].depth.load(std::memory_order_relaxed);
+        stats.maxDepth = queues[i].maxDepth.load(std::memory_order_relaxed);
+        result.queues.push_back(stats);
+    }
+
+    return result;
+}
+
+void Metrics::reset() {
+    for (auto& counters : stages) {
+        counters.count = 0;
+        counters.totalNs = 0;
+        counters.minNs = UINT64_MAX;
+        counters.maxNs = 0;
+        counters.allocations = 0;
+        for (auto& bucket : counters.histogram) {
+            bucket = 0;
+        }
+    }
+    for (auto& counters : queues) {
+        counters.depth = 0;
+        counters.maxDepth = 0;
+    }
+
+    std::lock_guard<std::mutex> lock(traceMutex);
+    traceEvents.clear();
+    traceStart = Clock::now();
+}
+
+void Metrics::setTracing(bool enabled) {
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if (enabled && !tracing) {
+        traceEvents.clear();
+        traceStart = Clock::now();
+    }
+    tracing = enabled;
+}
+
+bool Metrics::writeChromeTrace(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(traceMutex);
+    fprintf(file, "{\"traceEvents\":[");
+    for (size_t i = 0; i < traceEvents.size(); ++i) {
+        const TraceEvent& event = traceEvents[i];
+        fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"video_reader\",\"ph\":\"X\","
+                      "\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":1}",
+                i == 0 ? "" : ",", stageName(event.stage),
+                (long long)event.startUs, (long long)event.durationUs);
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    return fclose(file) == 0;
+}
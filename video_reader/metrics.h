@@ -0,0 +1,149 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Stages of the decoding pipelines which are timed individually
+enum class Stage {
+    Demux,
+    PacketSend,
+    Decode,
+    Scale,
+    TensorPrep,
+    Inference,
+    JpegEncode,
+    FileWrite,
+    Audio,
+    ToneMap,
+    Count
+};
+
+// Queues between stages whose depth is tracked
+enum class Queue {
+    FrameWindow,
+    Count
+};
+
+const char* stageName(Stage stage);
+const char* queueName(Queue queue);
+
+// Quotes and escapes a string for the JSON reports of the CLI and the benchmark
+std::string jsonString(const std::string& value);
+
+struct StageStats {
+    std::string name;
+    uint64_t count = 0;
+    double totalMs = 0.0;
+    double minMs = 0.0;
+    double maxMs = 0.0;
+    uint64_t allocations = 0;  // Heap allocations seen by the allocation counter, see Metrics::setAllocationCounter
+    // histogram[i] counts calls taking [2^(i-1), 2^i) microseconds, histogram[0] those below 1us
+    std::vector<uint64_t> histogram;
+};
+
+struct QueueStats {
+    std::string name;
+    uint64_t depth = 0;
+    uint64_t maxDepth = 0;
+};
+
+// Byte counters of the custom I/O layer, see media_io.h
+struct IoStats {
+    uint64_t bytesRead = 0;      // Read from storage, including read-ahead
+    uint64_t bytesConsumed = 0;  // Handed to the demuxer
+    uint64_t reads = 0;
+    uint64_t seeks = 0;
+};
+
+struct MetricsSnapshot {
+    std::vector<StageStats> stages;
+    std::vector<QueueStats> queues;
+    IoStats io;
+};
+
+// Lock-free counters and histograms per stage. Recording is done by the
+// decoding thread while snapshots may be taken from any other thread.
+class Metrics {
+public:
+    using Clock = std::chrono::steady_clock;
+    static const int HISTOGRAM_BUCKETS = 24;
+
+    Metrics();
+
+    void record(Stage stage, Clock::time_point start, Clock::time_point end, uint64_t allocations = 0);
+    void setQueueDepth(Queue queue, uint64_t depth);
+    MetricsSnapshot snapshot() const;
+    void reset();
+
+    // Trace events are only collected while tracing is enabled
+    void setTracing(bool enabled);
+    bool writeChromeTrace(const std::string& path) const;
+
+    // Process wide hook returning the number of allocations made so far by the
+    // calling thread. Only installed by instrumented builds such as the
+    // benchmark's allocation check, per-stage allocations stay zero otherwise.
+    using AllocationCounter = uint64_t (*)();
+    static void setAllocationCounter(AllocationCounter counter);
+    static uint64_t allocationCount();
+
+private:
+    struct StageCounters {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> totalNs{0};
+        std::atomic<uint64_t> minNs{UINT64_MAX};
+        std::atomic<uint64_t> maxNs{0};
+        std::atomic<uint64_t> allocations{0};
+        std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> histogram;
+    };
+
+    struct QueueCounters {
+        std::atomic<uint64_t> depth{0};
+        std::atomic<uint64_t> maxDepth{0};
+    };
+
+    struct TraceEvent {
+        Stage stage;
+        int64_t startUs;
+        int64_t durationUs;
+    };
+
+    static const size_t MAX_TRACE_EVENTS = 1 << 20;
+
+    std::array<StageCounters, static_cast<size_t>(Stage::Count)> stages;
+    std::array<QueueCounters, static_cast<size_t>(Queue::Count)> queues;
+
+    std::atomic<bool> tracing{false};
+    Clock::time_point traceStart;
+    mutable std::mutex traceMutex;
+    std::vector<TraceEvent> traceEvents;
+
+    static std::atomic<AllocationCounter> allocationCounter;
+};
+
+// Records the time and allocations between construction and destruction for a stage
+class ScopedStage {
+public:
+    ScopedStage(Metrics& metrics, Stage stage)
+        : metrics(metrics), stage(stage), allocations(Metrics::allocationCount()), start(Metrics::Clock::now()) {}
+    ~ScopedStage() {
+        Metrics::Clock::time_point end = Metrics::Clock::now();
+        metrics.record(stage, start, end, Metrics::allocationCount() - allocations);
+    }
+
+    ScopedStage(const ScopedStage&) = delete;
+    ScopedStage& operator=(const ScopedStage&) = delete;
+
+private:
+    Metrics& metrics;
+    Stage stage;
+    uint64_t allocations;
+    Metrics::Clock::time_point start;
+};
+
+#endif
@@ -0,0 +1,418 @@
+#include "model_descriptor.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <locale>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+struct JsonValue {
+    enum class Kind { String, Number, Bool, NumberArray };
+    Kind kind = Kind::Number;
+    std::string string;
+    double number = 0.0;
+    bool boolean = false;
+    std::vector<double> numbers;
+};
+
+// Minimal parser for the flat descriptor object: string, number, boolean and
+// number array values, no nesting
+class DescriptorParser {
+public:
+    DescriptorParser(const std::string& text, const std::string& path)
+        : text(text), path(path) {}
+
+    void parse(ModelDescriptor& descriptor) {
+        skipSpace();
+        expect('{');
+        skipSpace();
+        if (consume('}')) {
+            return;
+        }
+        do {
+            skipSpace();
+            std::string key = parseString();
+            skipSpace();
+            expect(':');
+            skipSpace();
+            JsonValue value = parseValue();
+            apply(descriptor, key, value);
+            skipSpace();
+        } while (consume(','));
+        expect('}');
+        skipSpace();
+        if (pos != text.size()) {
+            fail("unexpected content after the object");
+        }
+    }
+
+private:
+    [[noreturn]] void fail(const std::string& message) const {
+        throw std::runtime_error("Invalid model descriptor " + path + ": " + message);
+    }
+
+    void skipSpace() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' ||
+                                     text[pos] == '\n' || text[pos] == '\r')) {
+            pos++;
+        }
+    }
+
+    bool consume(char c) {
+        if (pos < text.size() && text[pos] == c) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!consume(c)) {
+            fail(std::string("expected '") + c + "' at offset " + std::to_string(pos));
+        }
+    }
+
+    std::string parseString() {
+        expect('"');
+        std::string result;
+        while (pos < text.size() && text[pos] != '"') {
+            if (text[pos] == '\\' && pos + 1 < text.size()) {
+                pos++;
+            }
+            result += text[pos++];
+        }
+        expect('"');
+        return result;
+    }
+
+    // Parsed in the classic locale, strtod would take the decimal separator
+    // of an LC_NUMERIC set by the host application
+    double parseNumber() {
+        size_t end = text.find_first_not_of("+-0123456789.eE", pos);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::istringstream stream(text.substr(pos, end - pos));
+        stream.imbue(std::locale::classic());
+        double value = 0.0;
+        if (end == pos || !(stream >> value) || stream.peek() != std::char_traits<char>::eof()) {
+            fail("expected a value at offset " + std::to_string(pos));
+        }
+        pos = end;
+        return value;
+    }
+
+    JsonValue parseValue() {
+        JsonValue value;
+        if (pos < text.size() && text[pos] == '"') {
+            value.kind = JsonValue::Kind::String;
+            value.string = parseString();
+        } else if (text.compare(pos, 4, "true") == 0 || text.compare(pos, 5, "false") == 0) {
+            value.kind = JsonValue::Kind::Bool;
+            value.boolean = text[pos] == 't';
+            pos += value.boolean ? 4 : 5;
+        } else if (consume('[')) {
+            value.kind = JsonValue::Kind::NumberArray;
+            skipSpace();
+            if (!consume(']')) {
+                do {
+                    skipSpace();
+                    value.numbers.push_back(parseNumber());
+                    skipSpace();
+                } while (consume(','));
+                expect(']');
+            }
+        } else {
+            value.number = parseNumber();
+        }
+        return value;
+    }
+
+    const JsonValue& require(const JsonValue& value, const std::string& key, JsonValue::Kind kind) const {
+        if (value.kind != kind) {
+            fail("wrong type for \"" + key + "\"");
+        }
+        return value;
+    }
+
+    int integer(const JsonValue& value, const std::string& key) const {
+        double number = require(value, key, JsonValue::Kind::Number).number;
+        if (number != std::floor(number)) {
+            fail("\"" + key + "\" has to be an integer");
+        }
+        return static_cast<int>(number);
+    }
+
+    void channelValues(const JsonValue& value, const std::string& key, float* out) const {
+        const std::vector<double>& numbers = require(value, key, JsonValue::Kind::NumberArray).numbers;
+        if (numbers.size() == 1) {
+            // A single value applies to all channels
+            for (int c = 0; c < ModelDescriptor::MAX_CHANNELS; ++c) {
+                out[c] = static_cast<float>(numbers[0]);
+            }
+        } else if (numbers.size() == ModelDescriptor::MAX_CHANNELS) {
+            for (int c = 0; c < ModelDescriptor::MAX_CHANNELS; ++c) {
+                out[c] = static_cast<float>(numbers[c]);
+            }
+        } else {
+            fail("\"" + key + "\" needs 1 or 3 values");
+        }
+    }
+
+    void apply(ModelDescriptor& d, const std::string& key, const JsonValue& value) const {
+        if (key == "input_name") {
+            d.inputName = require(value, key, JsonValue::Kind::String).string;
+        } else if (key == "output_name") {
+            d.outputName = require(value, key, JsonValue::Kind::String).string;
+        } else if (key == "width") {
+            d.width = integer(value, key);
+        } else if (key == "height") {
+            d.height = integer(value, key);
+        } else if (key == "channel_order") {
+            const std::string& order = require(value, key, JsonValue::Kind::String).string;
+            if (order == "rgb") {
+                d.channelOrder = ChannelOrder::Rgb;
+                d.channels = 3;
+            } else if (order == "bgr") {
+                d.channelOrder = ChannelOrder::Bgr;
+                d.channels = 3;
+            } else if (order == "gray") {
+                d.channelOrder = ChannelOrder::Gray;
+                d.channels = 1;
+            } else {
+                fail("unknown channel_order " + order);
+            }
+        } else if (key == "layout") {
+            const std::string& layout = require(value, key, JsonValue::Kind::String).string;
+            if (layout == "NTHWC") {
+                d.layout = TensorLayout::NTHWC;
+            } else if (layout == "NCTHW") {
+                d.layout = TensorLayout::NCTHW;
+            } else {
+                fail("unknown layout " + layout);
+            }
+        } else if (key == "scale") {
+            d.scale = static_cast<float>(require(value, key, JsonValue::Kind::Number).number);
+        } else if (key == "mean") {
+            channelValues(value, key, d.mean);
+        } else if (key == "std") {
+            channelValues(value, key, d.stddev);
+        } else if (key == "sequence_length") {
+            d.sequenceLength = integer(value, key);
+        } else if (key == "step") {
+            d.step = integer(value, key);
+        } else if (key == "padding") {
+            d.padding = integer(value, key);
+        } else if (key == "output_start") {
+            d.outputStart = integer(value, key);
+        } else if (key == "output_end") {
+            d.outputEnd = integer(value, key);
+        } else if (key == "output_channels") {
+            d.outputChannels = integer(value, key);
+        } else if (key == "output_channel") {
+            d.outputChannel = integer(value, key);
+        } else if (key == "output_activation") {
+            const std::string& activation = require(value, key, JsonValue::Kind::String).string;
+            if (activation == "none") {
+                d.outputActivation = OutputActivation::None;
+            } else if (activation == "sigmoid") {
+                d.outputActivation = OutputActivation::Sigmoid;
+            } else {
+                fail("unknown output_activation " + activation);
+            }
+        } else if (key == "threshold") {
+            d.threshold = static_cast<float>(require(value, key, JsonValue::Kind::Number).number);
+        } else {
+            fprintf(stderr, "Ignoring unknown key \"%s\" in %s\n", key.c_str(), path.c_str());
+        }
+    }
+
+    const std::string& text;
+    const std::string& path;
+    size_t pos = 0;
+};
+
+// Converts one window of packed frames. Pixels and channels are compile time
+// constants for the specialized kernels, 0 selects the runtime values of the
+// descriptor. The layout branches are resolved at compile time as well.
+template <int FixedPixels, int FixedChannels, TensorLayout Layout, bool Identity>
+void preprocessWindow(const ModelDescriptor& d, const Preprocessor::Affine& affine,
+                      const uint8_t* src, float* dst) {
+    const size_t pixels = FixedPixels ? FixedPixels : static_cast<size_t>(d.width) * d.height;
+    const int channels = FixedChannels ? FixedChannels : d.channels;
+    const size_t frames = d.sequenceLength;
+    const size_t frameValues = pixels * channels;
+
+    if (Layout == TensorLayout::NTHWC) {
+        // The tensor has the element order of the packed frames
+        for (size_t f = 0; f < frames; ++f) {
+            const uint8_t* in = src + f * frameValues;
+            float* out = dst + f * frameValues;
+            for (size_t p = 0; p < pixels; ++p) {
+                for (int c = 0; c < channels; ++c) {
+                    float value = in[p * channels + c];
+                    out[p * channels + c] = Identity ? value : value * affine.mul[c] + affine.add[c];
+                }
+            }
+        }
+    } else {
+        // One plane per channel, each holding all frames
+        const size_t plane = frames * pixels;
+        for (size_t f = 0; f < frames; ++f) {
+            const uint8_t* in = src + f * frameValues;
+            for (int c = 0; c < channels; ++c) {
+                float* out = dst + c * plane + f * pixels;
+                for (size_t p = 0; p < pixels; ++p) {
+                    float value = in[p * channels + c];
+                    out[p] = Identity ? value : value * affine.mul[c] + affine.add[c];
+                }
+            }
+        }
+    }
+}
+
+struct KernelEntry {
+    int width;
+    int height;
+    int channels;
+    TensorLayout layout;
+    bool identity;
+    Preprocessor::Kernel kernel;
+};
+
+// 48x27 RGB is used by TransNetV2 and its derivatives
+const KernelEntry SPECIALIZED_KERNELS[] = {
+    {48, 27, 3, TensorLayout::NTHWC, true, &preprocessWindow<48 * 27, 3, TensorLayout::NTHWC, true>},
+    {48, 27, 3, TensorLayout::NTHWC, false, &preprocessWindow<48 * 27, 3, TensorLayout::NTHWC, false>},
+    {48, 27, 3, TensorLayout::NCTHW, true, &preprocessWindow<48 * 27, 3, TensorLayout::NCTHW, true>},
+    {48, 27, 3, TensorLayout::NCTHW, false, &preprocessWindow<48 * 27, 3, TensorLayout::NCTHW, false>},
+};
+
+Preprocessor::Kernel genericKernel(TensorLayout layout, bool identity) {
+    if (layout == TensorLayout::NTHWC) {
+        return identity ? &preprocessWindow<0, 0, TensorLayout::NTHWC, true>
+                        : &preprocessWindow<0, 0, TensorLayout::NTHWC, false>;
+    }
+    return identity ? &preprocessWindow<0, 0, TensorLayout::NCTHW, true>
+                    : &preprocessWindow<0, 0, TensorLayout::NCTHW, false>;
+}
+
+}  // namespace
+
+std::string ModelDescriptor::pathForModel(const std::string& onnx_model_path) {
+    const std::string extension = ".onnx";
+    if (onnx_model_path.size() >= extension.size() &&
+        onnx_model_path.compare(onnx_model_path.size() - extension.size(), extension.size(), extension) == 0) {
+        return onnx_model_path.substr(0, onnx_model_path.size() - extension.size()) + ".json";
+    }
+    return onnx_model_path + ".json";
+}
+
+ModelDescriptor ModelDescriptor::forModel(const std::string& onnx_model_path) {
+    ModelDescriptor descriptor;
+    std::string path = pathForModel(onnx_model_path);
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return descriptor;
+    }
+
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    std::string text = contents.str();
+    DescriptorParser(text, path).parse(descriptor);
+    try {
+        descriptor.validate();
+    } catch (const std::runtime_error& e) {
+        throw std::runtime_error(std::string(e.what()) + " in " + path);
+    }
+    return descriptor;
+}
+
+void ModelDescriptor::validate() const {
+    auto fail = [](const std::string& message) {
+        throw std::runtime_error("Invalid model descriptor: " + message);
+    };
+
+    if (width <= 0 || height <= 0) {
+        fail("width and height have to be positive");
+    }
+    if (channels != (channelOrder == ChannelOrder::Gray ? 1 : 3)) {
+        fail("channel count does not match the channel order");
+    }
+    for (int c = 0; c < channels; ++c) {
+        if (stddev[c] == 0.0f) {
+            fail("std must not be 0");
+        }
+    }
+    if (step <= 0 || sequenceLength < step) {
+        fail("step has to be between 1 and sequence_length");
+    }
+    if (padding < 0 || padding + step > sequenceLength) {
+        fail("padding has to be at least 0 and padding + step at most sequence_length");
+    }
+    if (outputStart < 0 || outputEnd <= outputStart) {
+        fail("output_start has to be at least 0 and below output_end");
+    }
+    if (outputEnd - outputStart != step) {
+        fail("output_end - output_start has to equal step");
+    }
+    if (outputStart != padding || outputEnd > sequenceLength) {
+        fail("the output slice has to start at padding and end within the window");
+    }
+    if (outputChannels <= 0 || outputChannel < 0 || outputChannel >= outputChannels) {
+        fail("output_channel has to be below output_channels");
+    }
+}
+
+bool ModelDescriptor::identityNormalization() const {
+    for (int c = 0; c < channels; ++c) {
+        if (scale / stddev[c] != 1.0f || mean[c] != 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<int64_t> ModelDescriptor::inputShape() const {
+    if (layout == TensorLayout::NCTHW) {
+        return {1, channels, sequenceLength, height, width};
+    }
+    return {1, sequenceLength, height, width, channels};
+}
+
+float ModelDescriptor::score(const float* output, int frame) const {
+    float value = output[frame * outputChannels + outputChannel];
+    if (outputActivation == OutputActivation::Sigmoid) {
+        return 1.0f / (1.0f + std::exp(-value));
+    }
+    return value;
+}
+
+Preprocessor::Preprocessor(const ModelDescriptor& descriptor)
+    : descriptor(descriptor), is_specialized(false) {
+    // Fold scale, mean and std into one multiply-add per value
+    for (int c = 0; c < ModelDescriptor::MAX_CHANNELS; ++c) {
+        affine.mul[c] = descriptor.scale / descriptor.stddev[c];
+        affine.add[c] = -descriptor.mean[c] / descriptor.stddev[c];
+    }
+    bool identity = descriptor.identityNormalization();
+
+    kernel = genericKernel(descriptor.layout, identity);
+    for (const KernelEntry& entry : SPECIALIZED_KERNELS) {
+        if (entry.width == descriptor.width && entry.height == descriptor.height &&
+            entry.channels == descriptor.channels && entry.layout == descriptor.layout &&
+            entry.identity == identity) {
+            kernel = entry.kernel;
+            is_specialized = true;
+            break;
+        }
+    }
+}
+
+void Preprocessor::operator()(const uint8_t* frames, float* tensor) const {
+    kernel(descriptor, affine, frames, tensor);
+}
@@ -0,0 +1,111 @@
+#ifndef MODEL_DESCRIPTOR_H
+#define MODEL_DESCRIPTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class TensorLayout {
+    NTHWC,  // [1, frames, height, width, channels], TransNetV2
+    NCTHW   // [1, channels, frames, height, width]
+};
+
+enum class ChannelOrder {
+    Rgb,
+    Bgr,
+    Gray
+};
+
+enum class OutputActivation {
+    None,     // Model already outputs probabilities
+    Sigmoid   // Model outputs logits
+};
+
+// Describes the input and output of a shot boundary model. It is read from a
+// JSON file next to the model with the same name, e.g. transnetv2.json for
+// transnetv2.onnx. All keys are optional, missing keys and a missing file
+// fall back to the TransNetV2 values below:
+//
+// {
+//     "input_name": "input", "output_name": "534",
+//     "width": 48, "height": 27, "channel_order": "rgb", "layout": "NTHWC",
+//     "scale": 1.0, "mean": [0, 0, 0], "std": [1, 1, 1],
+//     "sequence_length": 100, "step": 50, "padding": 25,
+//     "output_start": 25, "output_end": 75,
+//     "output_channels": 1, "output_channel": 0,
+//     "output_activation": "none", "threshold": 0.5
+// }
+//
+// Pixels are normalized as (value * scale - mean[c]) / std[c]. The model
+// sees windows of sequence_length frames which advance by step frames, the
+// first window starts with padding copies of the first frame. Predictions
+// output_start to output_end of every window are used, so the slice has to
+// be step frames long and start at padding.
+struct ModelDescriptor {
+    static const int MAX_CHANNELS = 3;
+
+    std::string inputName = "input";
+    std::string outputName = "534";
+
+    int width = 48;
+    int height = 27;
+    int channels = 3;
+    ChannelOrder channelOrder = ChannelOrder::Rgb;
+    TensorLayout layout = TensorLayout::NTHWC;
+
+    float scale = 1.0f;
+    float mean[MAX_CHANNELS] = {0.0f, 0.0f, 0.0f};
+    float stddev[MAX_CHANNELS] = {1.0f, 1.0f, 1.0f};
+
+    int sequenceLength = 100;
+    int step = 50;
+    int padding = 25;
+
+    int outputStart = 25;
+    int outputEnd = 75;
+    int outputChannels = 1;  // Values per frame in the output tensor
+    int outputChannel = 0;   // Value used as shot boundary score
+    OutputActivation outputActivation = OutputActivation::None;
+    float threshold = 0.5f;
+
+    // Loads the descriptor belonging to onnx_model_path, throws
+    // std::runtime_error if the file exists but is invalid
+    static ModelDescriptor forModel(const std::string& onnx_model_path);
+    static std::string pathForModel(const std::string& onnx_model_path);
+
+    // Throws std::runtime_error describing the first inconsistent value
+    void validate() const;
+
+    // True if scale, mean and std leave the pixel values unchanged
+    bool identityNormalization() const;
+    size_t frameBytes() const { return static_cast<size_t>(width) * height * channels; }
+    std::vector<int64_t> inputShape() const;
+    float score(const float* output, int frame) const;
+};
+
+// Converts a window of packed 8 bit frames into the model's input tensor.
+// Common geometries use kernels specialized at compile time, everything
+// else goes through a generic kernel.
+class Preprocessor {
+public:
+    explicit Preprocessor(const ModelDescriptor& descriptor);
+
+    void operator()(const uint8_t* frames, float* tensor) const;
+    bool specialized() const { return is_specialized; }
+
+    struct Affine {
+        float mul[ModelDescriptor::MAX_CHANNELS];
+        float add[ModelDescriptor::MAX_CHANNELS];
+    };
+
+    using Kernel = void (*)(const ModelDescriptor&, const Affine&, const uint8_t*, float*);
+
+private:
+    const ModelDescriptor& descriptor;
+    Affine affine;
+    Kernel kernel;
+    bool is_specialized;
+};
+
+#endif
@@ -1,12 +1,290 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <video_reader.h>
+#include <analysis_scheduler.h>
+#include <exception>
+#include <stdexcept>
+#include <screenshot_archive.h>
+#include <video_probe.h>
 
 namespace py = pybind11;
 
+namespace {
+
+// Raised as video_reader.OperationCancelled by operations stopped by a
+// signal, e.g. a Celery revoke, or by an exception of a callback
+struct OperationCancelled : std::runtime_error {
+    OperationCancelled() : std::runtime_error("Operation cancelled") {}
+};
+
+py::dict progressToDict(const ProgressInfo& info) {
+    py::dict d;
+    d["frames_done"] = info.framesDone;
+    d["total_frames"] = info.totalFrames;
+    d["fps"] = info.fps;
+    d["eta"] = info.eta;
+    return d;
+}
+
+py::dict metricsToDict(const MetricsSnapshot& snapshot) {
+    py::dict stages;
+    for (const StageStats& stage : snapshot.stages) {
+        py::dict d;
+        d["count"] = stage.count;
+        d["total_ms"] = stage.totalMs;
+        d["min_ms"] = stage.minMs;
+        d["max_ms"] = stage.maxMs;
+        d["allocations"] = stage.allocations;
+        d["histogram"] = stage.histogram;
+        stages[py::str(stage.name)] = d;
+    }
+
+    py::dict queues;
+    for (const QueueStats& queue : snapshot.queues) {
+        py::dict d;
+        d["depth"] = queue.depth;
+        d["max_depth"] = queue.maxDepth;
+        queues[py::str(queue.name)] = d;
+    }
+
+    py::dict io;
+    io["bytes_read"] = snapshot.io.bytesRead;
+    io["bytes_consumed"] = snapshot.io.bytesConsumed;
+    io["reads"] = snapshot.io.reads;
+    io["seeks"] = snapshot.io.seeks;
+
+    py::dict result;
+    result["stages"] = stages;
+    result["queues"] = queues;
+    result["io"] = io;
+    return result;
+}
+
+py::dict audioAnalysisToDict(const AudioAnalysis& analysis) {
+    py::list shots;
+    for (const ShotLoudness& shot : analysis.shots) {
+        py::dict d;
+        d["start"] = shot.start;
+        d["end"] = shot.end;
+        d["rms_db"] = shot.rmsDb;
+        d["peak_db"] = shot.peakDb;
+        shots.append(d);
+    }
+
+    py::dict result;
+    result["sample_rate"] = analysis.sampleRate;
+    result["channels"] = analysis.channels;
+    result["envelope_rate"] = analysis.envelopeRate;
+    result["peak"] = analysis.peak;
+    result["rms"] = analysis.rms;
+    result["shots"] = shots;
+    return result;
+}
+
+// The callbacks are invoked from C++ while the GIL is released, so they
+// reacquire it before touching any Python object. An exception raised by a
+// callback, KeyboardInterrupt included, must not unwind through the reader:
+// it is kept, the operation is stopped and the exception is raised again
+// once the operation returned.
+template <typename Call>
+void callPython(VideoReader& reader, std::exception_ptr& error, Call call) {
+    py::gil_scoped_acquire gil;
+    if (error) {
+        return;
+    }
+    try {
+        call();
+    } catch (...) {
+        error = std::current_exception();
+        reader.cancel();
+    }
+}
+
+ProgressCallback wrapProgress(VideoReader& reader, std::exception_ptr& error, const py::object& on_progress) {
+    if (on_progress.is_none()) {
+        return nullptr;
+    }
+    return [&reader, &error, &on_progress](const ProgressInfo& info) {
+        callPython(reader, error, [&] { on_progress(progressToDict(info)); });
+    };
+}
+
+std::vector<std::vector<int>> detectShots(VideoReader& reader,
+                                          const std::string& onnx_model_path,
+                                          const py::object& on_progress,
+                                          const py::object& on_shot) {
+    std::exception_ptr error;
+    ShotCallback shotCallback = nullptr;
+    if (!on_shot.is_none()) {
+        shotCallback = [&reader, &error, &on_shot](int start, int end) {
+            callPython(reader, error, [&] { on_shot(start, end); });
+        };
+    }
+    ProgressCallback progressCallback = wrapProgress(reader, error, on_progress);
+
+    std::vector<std::vector<int>> shots;
+    {
+        py::gil_scoped_release release;
+        shots = reader.DetectShots(onnx_model_path, progressCallback, shotCallback);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    if (reader.lastStatus() == OperationStatus::Cancelled) {
+        throw OperationCancelled();
+    }
+    if (reader.lastStatus() == OperationStatus::Failed) {
+        throw std::runtime_error(reader.lastError());
+    }
+    return shots;
+}
+
+int generateScreenshots(VideoReader& reader,
+                        const std::string& directory,
+                        const std::vector<int>& frame_stamps,
+                        const py::object& on_progress,
+                        const py::object& on_screenshot) {
+    std::exception_ptr error;
+    ScreenshotCallback screenshotCallback = nullptr;
+    if (!on_screenshot.is_none()) {
+        screenshotCallback = [&reader, &error, &on_screenshot](int frame) {
+            callPython(reader, error, [&] { on_screenshot(frame); });
+        };
+    }
+    ProgressCallback progressCallback = wrapProgress(reader, error, on_progress);
+
+    int written;
+    {
+        py::gil_scoped_release release;
+        written = reader.generateScreenshots(directory, frame_stamps, progressCallback, screenshotCallback);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    if (reader.lastStatus() == OperationStatus::Cancelled) {
+        throw OperationCancelled();
+    }
+    return written;
+}
+
+// Dicts with directory, frame and optionally source
+std::vector<ArchiveScreenshot> toArchiveScreenshots(const py::list& screenshots) {
+    std::vector<ArchiveScreenshot> result;
+    for (const py::handle& item : screenshots) {
+        py::dict d = py::reinterpret_borrow<py::dict>(item);
+        ArchiveScreenshot screenshot;
+        screenshot.frame = d["frame"].cast<int>();
+        if (d.contains("directory")) {
+            screenshot.directory = d["directory"].cast<std::string>();
+        }
+        if (d.contains("source") && !d["source"].is_none()) {
+            screenshot.source = d["source"].cast<std::string>();
+        }
+        result.push_back(screenshot);
+    }
+    return result;
+}
+
+int exportScreenshots(VideoReader& reader,
+                      const std::string& zip_path,
+                      const py::list& screenshots,
+                      const py::object& on_progress) {
+    std::vector<ArchiveScreenshot> entries = toArchiveScreenshots(screenshots);
+    std::exception_ptr error;
+    ProgressCallback progressCallback = wrapProgress(reader, error, on_progress);
+
+    int written;
+    {
+        py::gil_scoped_release release;
+        written = reader.exportScreenshots(zip_path, entries, progressCallback);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    if (reader.lastStatus() == OperationStatus::Cancelled) {
+        throw OperationCancelled();
+    }
+    return written;
+}
+
+py::dict videoInfoToDict(const VideoInfo& info) {
+    py::dict d;
+    d["fps"] = info.fps;
+    d["width"] = info.width;
+    d["height"] = info.height;
+    d["numFrames"] = info.numFrames;
+    return d;
+}
+
+py::dict jobResultToDict(const JobResult& result) {
+    py::dict d;
+    d["id"] = result.id;
+    d["status"] = jobStatusName(result.status);
+    if (!result.error.empty()) {
+        d["error"] = result.error;
+    }
+    if (result.type == JobType::ShotDetection) {
+        d["result"] = result.shots;
+    } else if (result.type == JobType::Screenshots) {
+        d["result"] = result.screenshots;
+    } else {
+        d["result"] = videoInfoToDict(result.info);
+    }
+    return d;
+}
+
+}  // namespace
+
 PYBIND11_MODULE(video_reader, m) {
     m.doc() = "Python bindings for VideoReader class";
 
+    py::register_exception<OperationCancelled>(m, "OperationCancelled");
+
+    m.def("probe_video",
+          [](const std::string& path) {
+              VideoInfo info;
+              bool ok;
+              {
+                  py::gil_scoped_release release;
+                  ok = probeVideo(path, info);
+              }
+              if (!ok) {
+                  throw std::runtime_error("Failed to probe " + path);
+              }
+              return videoInfoToDict(info);
+          },
+          py::arg("path"),
+          "Get fps, width, height and numFrames from the container without decoding. "
+          "Results are cached per file path, size and modification time");
+
+    m.def("probe_videos",
+          [](const std::vector<std::string>& paths, int threads) {
+              std::vector<ProbeResult> results;
+              {
+                  py::gil_scoped_release release;
+                  results = probeVideos(paths, threads);
+              }
+              py::list list;
+              for (const ProbeResult& result : results) {
+                  list.append(result.ok ? py::object(videoInfoToDict(result.info)) : py::object(py::none()));
+              }
+              return list;
+          },
+          py::arg("paths"), py::arg("threads") = 0,
+          "Probe several files in parallel. Returns one dict per path, None for "
+          "files that could not be probed");
+
+    m.def("export_screenshot_files",
+          [](const std::string& zip_path, const py::list& screenshots, double fps) {
+              std::vector<ArchiveScreenshot> entries = toArchiveScreenshots(screenshots);
+              py::gil_scoped_release release;
+              return exportScreenshotFiles(zip_path, entries, fps);
+          },
+          py::arg("zip_path"), py::arg("screenshots"), py::arg("fps"),
+          "Copy existing screenshots into a new ZIP archive, named by timecode. "
+          "screenshots is a list of dicts with directory, frame and source. "
+          "Returns the number of screenshots written or -1 on errors");
+
     py::class_<VideoReader>(m, "VideoReader")
         .def(py::init<const std::string&>(), py::arg("file_path"),
              "Initialize VideoReader with a video file path")
@@ -14,6 +292,37 @@ PYBIND11_MODULE(video_reader, m) {
         .def("open", &VideoReader::Open,
              "Open the video file and initialize the decoder")
 
+        .def("set_io_options",
+             [](VideoReader& reader, const std::string& mode, size_t block_size, int read_ahead) {
+                 IoOptions options;
+                 if (!parseIoMode(mode, options.mode)) {
+                     throw py::value_error("Unknown I/O mode " + mode);
+                 }
+                 options.blockSize = block_size;
+                 options.readAhead = read_ahead;
+                 reader.setIoOptions(options);
+             },
+             py::arg("mode") = "auto", py::arg("block_size") = IoOptions().blockSize,
+             py::arg("read_ahead") = IoOptions().readAhead,
+             "Select the I/O layer before open(): auto, ffmpeg, mmap or buffered "
+             "with block size and number of read-ahead blocks")
+
+        .def("set_audio_options",
+             [](VideoReader& reader, bool enabled, int envelope_rate) {
+                 AudioOptions options;
+                 options.enabled = enabled;
+                 options.envelopeRate = envelope_rate;
+                 reader.setAudioOptions(options);
+             },
+             py::arg("enabled") = true, py::arg("envelope_rate") = AudioOptions().envelopeRate,
+             "Decode the audio during detect_shots, call before open(). envelope_rate "
+             "is the number of envelope values per second")
+
+        .def("get_audio_analysis",
+             [](const VideoReader& reader) { return audioAnalysisToDict(reader.getAudioAnalysis()); },
+             "Get the peak/RMS envelope and the loudness of each shot in dBFS "
+             "measured by the last detect_shots")
+
         .def("get_frame_rate", &VideoReader::getFrameRate,
              "Get the frame rate of the video")
 
@@ -29,14 +338,88 @@ PYBIND11_MODULE(video_reader, m) {
         .def("is_done", &VideoReader::Done,
              "Check if we've reached the end of the video")
 
-        .def("detect_shots", &VideoReader::DetectShots, py::arg("onnx_model_path"),
-             "Detect shot boundaries in the video using the specified ONNX model")
+        .def("detect_shots", &detectShots, py::arg("onnx_model_path"),
+             py::arg("on_progress") = py::none(), py::arg("on_shot") = py::none(),
+             "Detect shot boundaries in the video using the specified ONNX model. "
+             "on_progress receives a dict with frames_done, total_frames, fps and eta, "
+             "on_shot receives (start, end) as soon as a shot is final. Raises "
+             "OperationCancelled if stopped by a signal and RuntimeError on errors")
 
-        .def("generate_screenshots", &VideoReader::generateScreenshots,
+        .def("generate_screenshots", &generateScreenshots,
              py::arg("directory"), py::arg("frame_stamps"),
-             "Generate screenshots at specified frame timestamps")
+             py::arg("on_progress") = py::none(), py::arg("on_screenshot") = py::none(),
+             "Generate screenshots at specified frame timestamps. Returns the number written or -1 on errors. "
+             "on_screenshot receives the frame number of every written screenshot. Raises "
+             "OperationCancelled if stopped by a signal")
 
         .def("generate_screenshot", &VideoReader::generateScreenshot,
              py::arg("directory"), py::arg("frame"),
-             "Generate a screenshot at a specific frame number");
+             "Generate a screenshot at a specific frame number")
+
+        .def("export_screenshots", &exportScreenshots,
+             py::arg("zip_path"), py::arg("screenshots"), py::arg("on_progress") = py::none(),
+             "Write screenshots into a new ZIP archive, named by timecode. screenshots is "
+             "a list of dicts with directory, frame and optionally source; entries without "
+             "source are encoded from the video. Returns the number written or -1. Raises "
+             "OperationCancelled if stopped by a signal")
+
+        .def("get_metrics",
+             [](const VideoReader& reader) { return metricsToDict(reader.getMetrics()); },
+             "Get per-stage timings, queue depths and allocation counts")
+
+        .def("reset_metrics", &VideoReader::resetMetrics,
+             "Reset all collected metrics")
+
+        .def("set_tracing", &VideoReader::setTracing, py::arg("enabled"),
+             "Enable or disable collection of trace events")
+
+        .def("write_trace", &VideoReader::writeTrace, py::arg("path"),
+             "Write collected trace events as Chrome trace-event JSON");
+
+    py::class_<AnalysisScheduler>(m, "AnalysisScheduler")
+        .def(py::init<const std::string&, int, int>(),
+             py::arg("onnx_model_path"), py::arg("workers") = 0, py::arg("inference_threads") = 0,
+             "Create a scheduler sharing one ONNX session and thread budget between jobs. "
+             "workers and inference_threads default to a split of the hardware threads")
+
+        .def("submit_shot_detection", [](AnalysisScheduler& s, const std::string& path, int priority) {
+                 return s.submitShotDetection(path, priority);
+             },
+             py::arg("file_path"), py::arg("priority") = 0,
+             "Queue shot boundary detection, returns the job id")
+
+        .def("submit_screenshots",
+             [](AnalysisScheduler& s, const std::string& path, const std::string& directory,
+                const std::vector<int>& frame_stamps, int priority) {
+                 return s.submitScreenshots(path, directory, frame_stamps, priority);
+             },
+             py::arg("file_path"), py::arg("directory"), py::arg("frame_stamps"), py::arg("priority") = 0,
+             "Queue screenshot generation, returns the job id")
+
+        .def("submit_video_info", [](AnalysisScheduler& s, const std::string& path, int priority) {
+                 return s.submitVideoInfo(path, priority);
+             },
+             py::arg("file_path"), py::arg("priority") = 0,
+             "Queue reading the video info, returns the job id")
+
+        .def("cancel", &AnalysisScheduler::cancel, py::arg("job_id"),
+             "Cancel a queued or running job")
+
+        .def("status", [](const AnalysisScheduler& s, int id) { return jobStatusName(s.status(id)); },
+             py::arg("job_id"),
+             "Get the status of a job")
+
+        .def("wait", [](AnalysisScheduler& s, int id) {
+                 JobResult result;
+                 {
+                     py::gil_scoped_release release;
+                     result = s.wait(id);
+                 }
+                 return jobResultToDict(result);
+             },
+             py::arg("job_id"),
+             "Block until the job has finished and return a dict with id, status and result")
+
+        .def("pending", &AnalysisScheduler::pending,
+             "Number of queued and running jobs");
 }
@@ -0,0 +1,213 @@
+"""Creates a reduced precision variant of the shot boundary model.
+
+    python video_reader/quantize_model.py resources/transnetv2.onnx \\
+        resources/transnetv2.int8.onnx --mode int8 --calibrate a.mp4 b.mp4
+
+Modes:
+    int8          Static quantization of weights and activations (QDQ). Needs a
+                  few calibration videos, which are decoded with the ffmpeg
+                  command line tool.
+    int8-dynamic  Weights are stored as int8, activations are quantized at
+                  runtime. Needs no calibration but is usually slower than int8.
+    fp16          Weights and activations in float16, inputs and outputs stay
+                  float32. Only faster on CPUs with native fp16 arithmetic.
+
+Unless --float-input is given the graph input is changed to uint8 followed by
+a Cast node, so VideoReader passes the decoded frames without converting them
+to float first. The model descriptor (see model_descriptor.h) is copied next
+to the new model.
+
+The accuracy and speed against the float32 model can then be compared with
+    video_reader_benchmark --model resources/transnetv2.onnx \\
+        --model resources/transnetv2.int8.onnx
+
+Requires: pip install onnx onnxruntime onnxconverter-common numpy
+"""
+
+import argparse
+import json
+import shutil
+import subprocess
+import sys
+import tempfile
+from collections.abc import Iterator
+from pathlib import Path
+
+import numpy as np
+import onnx
+import onnxruntime
+from onnx import TensorProto, helper
+from onnxruntime.quantization import (
+    CalibrationDataReader,
+    QuantFormat,
+    QuantType,
+    quantize_dynamic,
+    quantize_static,
+)
+from onnxruntime.quantization.shape_inference import quant_pre_process
+
+# Keep in sync with the defaults of ModelDescriptor
+DEFAULT_DESCRIPTOR = {
+    'input_name': 'input',
+    'output_name': '534',
+    'width': 48,
+    'height': 27,
+    'channel_order': 'rgb',
+    'layout': 'NTHWC',
+    'scale': 1.0,
+    'mean': [0.0],
+    'std': [1.0],
+    'sequence_length': 100,
+    'step': 50,
+}
+
+PIXEL_FORMATS = {'rgb': ('rgb24', 3), 'bgr': ('bgr24', 3), 'gray': ('gray', 1)}
+
+
+def descriptor_path(model: Path) -> Path:
+    return model.with_suffix('.json')
+
+
+def load_descriptor(model: Path) -> dict:
+    descriptor = dict(DEFAULT_DESCRIPTOR)
+    path = descriptor_path(model)
+    if path.exists():
+        descriptor.update(json.loads(path.read_text()))
+    return descriptor
+
+
+def has_normalization(descriptor: dict) -> bool:
+    return (
+        descriptor['scale'] != 1.0
+        or any(m != 0.0 for m in descriptor['mean'])
+        or any(s != 1.0 for s in descriptor['std'])
+    )
+
+
+def read_windows(video: Path, descriptor: dict, limit: int) -> Iterator[np.ndarray]:
+    """Yields model inputs of the video, windowed and normalized like DetectShots."""
+    width, height = descriptor['width'], descriptor['height']
+    pix_fmt, channels = PIXEL_FORMATS[descriptor['channel_order']]
+    length, step = descriptor['sequence_length'], descriptor['step']
+    frame_bytes = width * height * channels
+
+    command = [
+        'ffmpeg', '-v', 'error', '-i', str(video),
+        '-vf', f'scale={width}:{height}:flags=bicubic',
+        '-f', 'rawvideo', '-pix_fmt', pix_fmt, '-',
+    ]  # fmt: skip
+    with subprocess.Popen(command, stdout=subprocess.PIPE) as process:  # noqa: S603
+        frames: list[np.ndarray] = []
+        count = 0
+        while count < limit:
+            data = process.stdout.read(frame_bytes)
+            if len(data) < frame_bytes:
+                break
+            frames.append(np.frombuffer(data, np.uint8).reshape(height, width, channels))
+            if len(frames) == length:
+                window = np.stack(frames).astype(np.float32)[np.newaxis]
+                mean = np.asarray(descriptor['mean'], np.float32)
+                std = np.asarray(descriptor['std'], np.float32)
+                window = (window * descriptor['scale'] - mean) / std
+                if descriptor['layout'] == 'NCTHW':
+                    window = window.transpose(0, 4, 1, 2, 3)
+                yield np.ascontiguousarray(window)
+                frames = frames[step:]
+                count += 1
+        process.kill()
+
+
+class WindowReader(CalibrationDataReader):
+    def __init__(self, windows: list[np.ndarray], input_name: str) -> None:
+        self.inputs = iter([{input_name: window} for window in windows])
+
+    def get_next(self) -> dict | None:
+        return next(self.inputs, None)
+
+
+def make_uint8_input(model: onnx.ModelProto, input_name: str) -> None:
+    """Changes the graph input to uint8 and casts it to float inside the graph."""
+    graph = model.graph
+    cast_output = input_name + '_float'
+    for node in graph.node:
+        for i, name in enumerate(node.input):
+            if name == input_name:
+                node.input[i] = cast_output
+    graph_input = next(i for i in graph.input if i.name == input_name)
+    graph_input.type.tensor_type.elem_type = TensorProto.UINT8
+    graph.node.insert(
+        0, helper.make_node('Cast', [input_name], [cast_output], to=TensorProto.FLOAT)
+    )
+
+
+def compare(reference: Path, converted: Path, windows: list[np.ndarray], descriptor: dict) -> None:
+    """Prints how far the predictions of the converted model are off."""
+    ref = onnxruntime.InferenceSession(str(reference))
+    new = onnxruntime.InferenceSession(str(converted))
+    input_type = new.get_inputs()[0].type
+    diffs = []
+    for window in windows:
+        expected = ref.run([descriptor['output_name']], {descriptor['input_name']: window})[0]
+        feed = window.astype(np.uint8) if input_type == 'tensor(uint8)' else window
+        actual = new.run([descriptor['output_name']], {descriptor['input_name']: feed})[0]
+        diffs.append(np.abs(expected - actual).max())
+    print(f'Max prediction difference on {len(windows)} windows: {max(diffs):.4f}')  # noqa: T201
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('model', type=Path, help='float32 model, e.g. resources/transnetv2.onnx')
+    parser.add_argument('output', type=Path, help='path of the converted model')
+    parser.add_argument('--mode', choices=['int8', 'int8-dynamic', 'fp16'], default='int8')
+    parser.add_argument('--calibrate', type=Path, nargs='*', default=[], help='videos for int8 calibration')
+    parser.add_argument('--windows', type=int, default=20, help='calibration windows per video')
+    parser.add_argument('--float-input', action='store_true', help='keep the float32 graph input')
+    args = parser.parse_args()
+
+    descriptor = load_descriptor(args.model)
+    uint8_input = not args.float_input
+    if uint8_input and (descriptor['layout'] != 'NTHWC' or has_normalization(descriptor)):
+        sys.exit('uint8 input needs NTHWC layout without normalization, use --float-input')
+    if args.mode == 'int8' and not args.calibrate:
+        sys.exit('int8 needs --calibrate videos, or use --mode int8-dynamic')
+
+    windows = [w for video in args.calibrate for w in read_windows(video, descriptor, args.windows)]
+
+    with tempfile.TemporaryDirectory() as tmp:
+        prepared = Path(tmp) / 'prepared.onnx'
+        quantized = Path(tmp) / 'quantized.onnx'
+        if args.mode == 'fp16':
+            from onnxconverter_common import float16
+
+            model = float16.convert_float_to_float16(onnx.load(str(args.model)), keep_io_types=True)
+            onnx.save(model, str(quantized))
+        else:
+            quant_pre_process(str(args.model), str(prepared))
+            if args.mode == 'int8':
+                quantize_static(
+                    str(prepared),
+                    str(quantized),
+                    WindowReader(windows, descriptor['input_name']),
+                    quant_format=QuantFormat.QDQ,
+                    activation_type=QuantType.QUInt8,
+                    weight_type=QuantType.QInt8,
+                    per_channel=True,
+                )
+            else:
+                quantize_dynamic(str(prepared), str(quantized), weight_type=QuantType.QInt8)
+
+        model = onnx.load(str(quantized))
+        if uint8_input:
+            make_uint8_input(model, descriptor['input_name'])
+        onnx.checker.check_model(model)
+        onnx.save(model, str(args.output))
+
+    if descriptor_path(args.model).exists():
+        shutil.copyfile(descriptor_path(args.model), descriptor_path(args.output))
+    if windows:
+        compare(args.model, args.output, windows, descriptor)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
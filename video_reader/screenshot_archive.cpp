@@ -0,0 +1,57 @@
+#include "screenshot_archive.h"
+
+#include <cmath>
+#include <cstdio>
+
+std::string screenshotArchiveName(int frame, double fps) {
+    double t = fps > 0 ? frame / fps : 0.0;
+    int hours = static_cast<int>(t / 3600);
+    int minutes = static_cast<int>(std::fmod(t, 3600) / 60);
+
+    // Seconds keep two decimals with '_' as separator and are not zero padded
+    char seconds[16];
+    snprintf(seconds, sizeof(seconds), "%.2f", std::fmod(t, 60));
+    for (char* c = seconds; *c; ++c) {
+        if (*c == '.' || *c == ',') {
+            *c = '_';
+        }
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "%02d-%02d-%s.jpg", hours, minutes, seconds);
+    return name;
+}
+
+std::string prepareArchiveEntry(ZipWriter& zip, const ArchiveScreenshot& screenshot, double fps) {
+    std::string name = screenshotArchiveName(screenshot.frame, fps);
+    if (!screenshot.directory.empty()) {
+        if (!zip.hasEntry(screenshot.directory + "/") && !zip.addDirectory(screenshot.directory)) {
+            return std::string();
+        }
+        name = screenshot.directory + "/" + name;
+    }
+    // Several screenshots of the same frame in one directory share the name
+    return zip.hasEntry(name) ? std::string() : name;
+}
+
+int exportScreenshotFiles(const std::string& zip_path, const std::vector<ArchiveScreenshot>& screenshots, double fps) {
+    ZipWriter zip;
+    if (!zip.open(zip_path)) {
+        return -1;
+    }
+
+    int written = 0;
+    for (const ArchiveScreenshot& screenshot : screenshots) {
+        std::string name = prepareArchiveEntry(zip, screenshot, fps);
+        if (name.empty()) {
+            continue;
+        }
+        if (zip.addFileFromDisk(name, screenshot.source)) {
+            written++;
+        } else {
+            fprintf(stderr, "Failed to copy screenshot %s\n", screenshot.source.c_str());
+        }
+    }
+
+    return zip.finish() ? written : -1;
+}
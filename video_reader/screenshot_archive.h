@@ -0,0 +1,28 @@
+#ifndef SCREENSHOT_ARCHIVE_H
+#define SCREENSHOT_ARCHIVE_H
+
+#include <string>
+#include <vector>
+
+#include "zip_writer.h"
+
+// Screenshot written to an export archive as <directory>/<timecode>.jpg
+struct ArchiveScreenshot {
+    std::string directory;  // Folder inside the archive, e.g. the timeline name
+    int frame = 0;
+    std::string source;     // Existing JPEG to copy, empty to encode the frame from the video
+};
+
+// Timecode file name used by the screenshot exports, e.g. 00-01-5_20.jpg
+std::string screenshotArchiveName(int frame, double fps);
+
+// Adds the directory of the screenshot to the archive if needed and returns
+// the entry name, or an empty string if the archive already has that name
+std::string prepareArchiveEntry(ZipWriter& zip, const ArchiveScreenshot& screenshot, double fps);
+
+// Copies existing screenshots into a new archive without decoding anything.
+// Returns the number of screenshots written, missing sources are skipped,
+// or -1 if the archive could not be written.
+int exportScreenshotFiles(const std::string& zip_path, const std::vector<ArchiveScreenshot>& screenshots, double fps);
+
+#endif
@@ -0,0 +1,109 @@
+#include "shot_model.h"
+
+#include <stdexcept>
+
+#include <onnxruntime_cxx_api.h>
+
+namespace {
+
+int indexOf(const std::vector<std::string>& names, const std::string& name) {
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (names[i] == name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+}  // namespace
+
+struct ShotModel::Impl {
+    Ort::Env env{ORT_LOGGING_LEVEL_WARNING, "shot_detection"};
+    Ort::Session session{nullptr};
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+    const char* inputNames[1];
+    const char* outputNames[1];
+
+    void run(Ort::Value& inputTensor, std::vector<float>& output) {
+        auto outputTensors = session.Run(Ort::RunOptions{nullptr},
+                                         inputNames, &inputTensor, 1,
+                                         outputNames, 1);
+
+        const float* rawResult = outputTensors[0].GetTensorMutableData<float>();
+        size_t count = outputTensors[0].GetTensorTypeAndShapeInfo().GetElementCount();
+        output.assign(rawResult, rawResult + count);
+    }
+};
+
+ShotModel::ShotModel(const std::string& onnx_model_path, int intra_op_threads)
+    : model_descriptor(ModelDescriptor::forModel(onnx_model_path)), impl(new Impl()) {
+    Ort::SessionOptions session_options;
+    if (intra_op_threads > 0) {
+        session_options.SetIntraOpNumThreads(intra_op_threads);
+        session_options.SetInterOpNumThreads(1);
+    }
+    #ifdef _WIN32
+        std::wstring wide_path(onnx_model_path.begin(), onnx_model_path.end());
+        impl->session = Ort::Session(impl->env, wide_path.c_str(), session_options);
+    #else
+        impl->session = Ort::Session(impl->env, onnx_model_path.c_str(), session_options);
+    #endif
+
+    Ort::AllocatorWithDefaultOptions allocator;
+    std::vector<std::string> inputs;
+    std::vector<std::string> outputs;
+    for (size_t i = 0; i < impl->session.GetInputCount(); ++i) {
+        inputs.push_back(impl->session.GetInputNameAllocated(i, allocator).get());
+    }
+    for (size_t i = 0; i < impl->session.GetOutputCount(); ++i) {
+        outputs.push_back(impl->session.GetOutputNameAllocated(i, allocator).get());
+    }
+    int input = indexOf(inputs, model_descriptor.inputName);
+    int output = indexOf(outputs, model_descriptor.outputName);
+    if (input < 0) {
+        throw std::runtime_error("Model " + onnx_model_path + " has no input " + model_descriptor.inputName);
+    }
+    if (output < 0) {
+        throw std::runtime_error("Model " + onnx_model_path + " has no output " + model_descriptor.outputName);
+    }
+
+    // Quantized models created by quantize_model.py take the frames as uint8
+    // and convert them inside the graph, normalization has to happen there too
+    ONNXTensorElementDataType inputType =
+        impl->session.GetInputTypeInfo(input).GetTensorTypeAndShapeInfo().GetElementType();
+    if (inputType == ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8) {
+        if (model_descriptor.layout != TensorLayout::NTHWC || !model_descriptor.identityNormalization()) {
+            throw std::runtime_error("Model " + onnx_model_path +
+                                     " takes uint8 input, which needs NTHWC layout without normalization");
+        }
+        uint8_input = true;
+    } else if (inputType != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
+        throw std::runtime_error("Model " + onnx_model_path + " needs a float or uint8 input");
+    }
+    if (impl->session.GetOutputTypeInfo(output).GetTensorTypeAndShapeInfo().GetElementType() !=
+        ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
+        throw std::runtime_error("Model " + onnx_model_path + " needs a float output");
+    }
+
+    impl->inputNames[0] = model_descriptor.inputName.c_str();
+    impl->outputNames[0] = model_descriptor.outputName.c_str();
+}
+
+ShotModel::~ShotModel() {}
+
+void ShotModel::run(std::vector<float>& input, const std::vector<int64_t>& shape, std::vector<float>& output) {
+    Ort::Value inputTensor = Ort::Value::CreateTensor<float>(
+        impl->memoryInfo, input.data(), input.size(), shape.data(), shape.size());
+
+    std::lock_guard<std::mutex> lock(run_mutex);
+    impl->run(inputTensor, output);
+}
+
+void ShotModel::run(const uint8_t* input, size_t size, const std::vector<int64_t>& shape, std::vector<float>& output) {
+    // ONNX Runtime does not write to input tensors
+    Ort::Value inputTensor = Ort::Value::CreateTensor<uint8_t>(
+        impl->memoryInfo, const_cast<uint8_t*>(input), size, shape.data(), shape.size());
+
+    std::lock_guard<std::mutex> lock(run_mutex);
+    impl->run(inputTensor, output);
+}
@@ -0,0 +1,43 @@
+#ifndef SHOT_MODEL_H
+#define SHOT_MODEL_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "model_descriptor.h"
+
+// ONNX Runtime session of the shot boundary model. One instance can be
+// shared by several VideoReaders, inference calls are serialized so that
+// the session's intra-op thread pool is never oversubscribed.
+class ShotModel {
+public:
+    // intra_op_threads <= 0 lets ONNX Runtime use all cores. Loads the model
+    // descriptor next to the model and throws std::runtime_error if it is
+    // invalid or names tensors the model does not have.
+    explicit ShotModel(const std::string& onnx_model_path, int intra_op_threads = 0);
+    ~ShotModel();
+
+    ShotModel(const ShotModel&) = delete;
+    ShotModel& operator=(const ShotModel&) = delete;
+
+    const ModelDescriptor& descriptor() const { return model_descriptor; }
+
+    // True for quantized models taking the packed uint8 frames directly
+    bool takesBytes() const { return uint8_input; }
+
+    // Runs the model on one input tensor and copies the descriptor's output into output
+    void run(std::vector<float>& input, const std::vector<int64_t>& shape, std::vector<float>& output);
+    void run(const uint8_t* input, size_t size, const std::vector<int64_t>& shape, std::vector<float>& output);
+
+private:
+    ModelDescriptor model_descriptor;
+    bool uint8_input = false;
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+    std::mutex run_mutex;
+};
+
+#endif
@@ -0,0 +1,377 @@
+#include "tone_mapping.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace {
+
+const int TABLE_SIZE = 4096;
+
+// Linear light is relative to SDR reference white (BT.2408). Highlights are
+// compressed from KNEE up to the nominal mastering peak, brighter ones clip.
+const float REFERENCE_WHITE_NITS = 203.0f;
+const float PEAK_NITS = 1000.0f;
+const float KNEE = 0.5f;
+const float PEAK = PEAK_NITS / REFERENCE_WHITE_NITS;
+const float KNEE_SCALE = 1.0f / (1.0f - KNEE);
+const float PEAK_EXCESS = (PEAK - KNEE) * KNEE_SCALE;
+const float INV_PEAK_EXCESS_SQUARED = 1.0f / (PEAK_EXCESS * PEAK_EXCESS);
+
+// Linear BT.2020 to BT.709 primaries
+const float BT2020_TO_BT709[9] = {
+     1.6605f, -0.5876f, -0.0728f,
+    -0.1246f,  1.1329f, -0.0083f,
+    -0.0182f, -0.1006f,  1.1187f,
+};
+const float IDENTITY[9] = {
+    1.0f, 0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 1.0f,
+};
+
+double pqToLinear(double signal) {
+    const double m1 = 2610.0 / 16384.0;
+    const double m2 = 2523.0 / 4096.0 * 128.0;
+    const double c1 = 3424.0 / 4096.0;
+    const double c2 = 2413.0 / 4096.0 * 32.0;
+    const double c3 = 2392.0 / 4096.0 * 32.0;
+    double p = std::pow(signal, 1.0 / m2);
+    double nits = 10000.0 * std::pow(std::max(p - c1, 0.0) / (c2 - c3 * p), 1.0 / m1);
+    return nits / REFERENCE_WHITE_NITS;
+}
+
+// Inverse OETF followed by the OOTF of a display with the nominal peak,
+// applied per channel
+double hlgToLinear(double signal) {
+    const double a = 0.17883277;
+    const double b = 0.28466892;
+    const double c = 0.55991073;
+    double scene = signal <= 0.5 ? signal * signal / 3.0 : (std::exp((signal - c) / a) + b) / 12.0;
+    return PEAK_NITS * std::pow(scene, 1.2) / REFERENCE_WHITE_NITS;
+}
+
+inline float clampUnit(float value) {
+    return std::min(std::max(value, 0.0f), 1.0f);
+}
+
+// value must be in [0, 1]
+inline int tableIndex(float value) {
+    return static_cast<int>(value * (TABLE_SIZE - 1) + 0.5f);
+}
+
+inline uint8_t toByte(float value) {
+    return static_cast<uint8_t>(static_cast<int>(std::min(std::max(value + 0.5f, 0.0f), 255.0f)));
+}
+
+// Extended Reinhard curve on the excess over the knee, reaching 1 at the
+// peak, as a factor on linear light. Computes max(lum, KNEE) without a
+// compare so the loops calling it stay branch free and vectorize.
+inline float toneScale(float lum) {
+    float over = lum - KNEE;
+    float above = KNEE + 0.5f * (over + std::fabs(over));
+    float excess = (above - KNEE) * KNEE_SCALE;
+    float mapped = KNEE * (1.0f + excess) + (1.0f - KNEE) * excess * (1.0f + excess * INV_PEAK_EXCESS_SQUARED);
+    return mapped / ((1.0f + excess) * above);
+}
+
+// Maps codes of the given depth and range to signal values, luma to [0, 1]
+// and chroma to [-0.5, 0.5]
+struct SignalScale {
+    float luma_scale, luma_offset, chroma_scale, chroma_offset;
+};
+
+SignalScale signalScale(int depth, bool full_range) {
+    if (full_range) {
+        float max_code = static_cast<float>((1 << depth) - 1);
+        return {1.0f / max_code, 0.0f, 1.0f / max_code, -static_cast<float>(1 << (depth - 1)) / max_code};
+    }
+    float step = static_cast<float>(1 << (depth - 8));
+    return {1.0f / (219.0f * step), -16.0f / 219.0f, 1.0f / (224.0f * step), -128.0f / 224.0f};
+}
+
+inline const uint16_t* row16(const AVFrame* frame, int plane, int y) {
+    return reinterpret_cast<const uint16_t*>(frame->data[plane] + static_cast<ptrdiff_t>(y) * frame->linesize[plane]);
+}
+
+// Planar little endian YUV 4:2:0 with more than 8 bits, e.g. yuv420p10le,
+// which the tone mapper reads without conversion
+bool isWidePlanar420(const AVPixFmtDescriptor* desc) {
+    return desc && (desc->flags & AV_PIX_FMT_FLAG_PLANAR) && !(desc->flags & AV_PIX_FMT_FLAG_BE) &&
+           !(desc->flags & AV_PIX_FMT_FLAG_RGB) && desc->nb_components >= 3 &&
+           desc->log2_chroma_w == 1 && desc->log2_chroma_h == 1 &&
+           desc->comp[0].depth > 8 && desc->comp[0].step == 2 && desc->comp[0].shift == 0;
+}
+
+// Keeps the buffers while geometry and format stay the same
+bool ensureBuffer(AVFrame* frame, int width, int height, AVPixelFormat format) {
+    if (frame->data[0] && frame->width == width && frame->height == height && frame->format == format) {
+        return av_frame_make_writable(frame) >= 0;
+    }
+    av_frame_unref(frame);
+    frame->width = width;
+    frame->height = height;
+    frame->format = format;
+    return av_frame_get_buffer(frame, 0) >= 0;
+}
+
+}  // namespace
+
+Transfer frameTransfer(const AVFrame* frame) {
+    if (frame->color_trc == AVCOL_TRC_SMPTE2084) {
+        return Transfer::Pq;
+    }
+    if (frame->color_trc == AVCOL_TRC_ARIB_STD_B67) {
+        return Transfer::Hlg;
+    }
+    return Transfer::Sdr;
+}
+
+bool needsScreenshotConversion(const AVFrame* frame) {
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+    if (!desc) {
+        return false;
+    }
+    return desc->comp[0].depth > 8 || frameTransfer(frame) != Transfer::Sdr;
+}
+
+ToneMapper::ToneMapper() {}
+
+ToneMapper::~ToneMapper() {
+    av_frame_free(&output);
+    av_frame_free(&wide);
+    sws_freeContext(sdr_ctx);
+    sws_freeContext(wide_ctx);
+}
+
+AVFrame* ToneMapper::convert(const AVFrame* frame) {
+    if (!output && !(output = av_frame_alloc())) {
+        return nullptr;
+    }
+    if (!ensureBuffer(output, frame->width, frame->height, AV_PIX_FMT_YUV420P)) {
+        return nullptr;
+    }
+
+    Transfer transfer = frameTransfer(frame);
+    AVFrame* result = transfer == Transfer::Sdr ? convertSdr(frame) : toneMap(frame, transfer);
+    if (result) {
+        result->color_range = AVCOL_RANGE_JPEG;
+        result->colorspace = AVCOL_SPC_BT470BG;
+    }
+    return result;
+}
+
+AVFrame* ToneMapper::convertSdr(const AVFrame* frame) {
+    sdr_ctx = sws_getCachedContext(sdr_ctx,
+        frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+        frame->width, frame->height, AV_PIX_FMT_YUV420P,
+        SWS_BILINEAR, nullptr, nullptr, nullptr
+    );
+    if (!sdr_ctx) {
+        return nullptr;
+    }
+
+    // Only the range changes, the matrix is left to the viewer as for 8-bit videos
+    const int* coefficients = sws_getCoefficients(SWS_CS_DEFAULT);
+    sws_setColorspaceDetails(sdr_ctx, coefficients, frame->color_range == AVCOL_RANGE_JPEG,
+                             coefficients, 1, 0, 1 << 16, 1 << 16);
+    sws_scale(sdr_ctx, frame->data, frame->linesize, 0, frame->height, output->data, output->linesize);
+    return output;
+}
+
+AVFrame* ToneMapper::toneMap(const AVFrame* frame, Transfer transfer) {
+    const int width = frame->width;
+    const int height = frame->height;
+
+    // Other layouts, e.g. P010 from hardware decoders, go through 16-bit planar first
+    const AVFrame* source = frame;
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+    int depth = 16;
+    if (isWidePlanar420(desc)) {
+        depth = desc->comp[0].depth;
+    } else {
+        wide_ctx = sws_getCachedContext(wide_ctx,
+            width, height, static_cast<AVPixelFormat>(frame->format),
+            width, height, AV_PIX_FMT_YUV420P16LE,
+            SWS_BILINEAR, nullptr, nullptr, nullptr
+        );
+        if (!wide_ctx || (!wide && !(wide = av_frame_alloc())) ||
+            !ensureBuffer(wide, width, height, AV_PIX_FMT_YUV420P16LE)) {
+            return nullptr;
+        }
+        sws_scale(wide_ctx, frame->data, frame->linesize, 0, height, wide->data, wide->linesize);
+        source = wide;
+    }
+
+    bool full_range = frame->color_range == AVCOL_RANGE_JPEG;
+    if (eotf.empty() || table_transfer != transfer || table_depth != depth || table_full_range != full_range) {
+        buildTables(transfer, depth, full_range);
+    }
+    setMatrices(frame);
+    const SignalScale scale = signalScale(depth, full_range);
+    const int max_code = (1 << depth) - 1;
+    const float* curve = neutral.data();
+
+    const int pairs = width / 2;
+    const int blocks = (width + 1) / 2;
+    for (std::vector<float>* buffer : {&block_code, &luma_row, &cb_row, &cr_row, &red, &green, &blue, &block_luma}) {
+        buffer->resize(blocks);
+    }
+
+    for (int y = 0; y < height; y += 2) {
+        const uint16_t* y0 = row16(source, 0, y);
+        const uint16_t* y1 = y + 1 < height ? row16(source, 0, y + 1) : y0;
+        const uint16_t* u = row16(source, 1, y / 2);
+        const uint16_t* v = row16(source, 2, y / 2);
+
+        float* code = block_code.data();
+        for (int x = 0; x < pairs; ++x) {
+            code[x] = 0.25f * (y0[2 * x] + y0[2 * x + 1] + y1[2 * x] + y1[2 * x + 1]);
+        }
+        if (blocks > pairs) {
+            code[pairs] = 0.5f * (y0[width - 1] + y1[width - 1]);
+        }
+        float* luma = luma_row.data();
+        float* cb = cb_row.data();
+        float* cr = cr_row.data();
+        for (int x = 0; x < blocks; ++x) {
+            luma[x] = code[x] * scale.luma_scale + scale.luma_offset;
+            cb[x] = u[x] * scale.chroma_scale + scale.chroma_offset;
+            cr[x] = v[x] * scale.chroma_scale + scale.chroma_offset;
+        }
+
+        mapBlocks(blocks, output->data[1] + static_cast<ptrdiff_t>(y / 2) * output->linesize[1],
+                  output->data[2] + static_cast<ptrdiff_t>(y / 2) * output->linesize[2]);
+
+        // Turn the mapped block luma into an offset on the neutral curve
+        float* offset = block_luma.data();
+        for (int x = 0; x < blocks; ++x) {
+            offset[x] -= curve[std::min(static_cast<int>(code[x] + 0.5f), max_code)];
+        }
+
+        for (int i = 0; i < 2 && y + i < height; ++i) {
+            const uint16_t* in = i == 0 ? y0 : y1;
+            uint8_t* out = output->data[0] + static_cast<ptrdiff_t>(y + i) * output->linesize[0];
+            for (int x = 0; x < pairs; ++x) {
+                out[2 * x] = toByte(curve[std::min<int>(in[2 * x], max_code)] + offset[x]);
+                out[2 * x + 1] = toByte(curve[std::min<int>(in[2 * x + 1], max_code)] + offset[x]);
+            }
+            if (blocks > pairs) {
+                out[width - 1] = toByte(curve[std::min<int>(in[width - 1], max_code)] + offset[pairs]);
+            }
+        }
+    }
+    return output;
+}
+
+void ToneMapper::buildTables(Transfer transfer, int depth, bool full_range) {
+    auto toLinear = [transfer](double signal) {
+        return transfer == Transfer::Pq ? pqToLinear(signal) : hlgToLinear(signal);
+    };
+
+    eotf.resize(TABLE_SIZE);
+    gamma.resize(TABLE_SIZE);
+    for (int i = 0; i < TABLE_SIZE; ++i) {
+        double value = static_cast<double>(i) / (TABLE_SIZE - 1);
+        eotf[i] = static_cast<float>(toLinear(value));
+        // Indexed by the square root of linear light for precision in the shadows
+        gamma[i] = static_cast<float>(std::pow(value, 2.0 / 2.2));
+    }
+
+    // Grey keeps R = G = B through the gamut conversion, so its luminance is
+    // the linear light of the luma signal
+    const SignalScale scale = signalScale(depth, full_range);
+    neutral.resize(static_cast<size_t>(1) << depth);
+    for (size_t code = 0; code < neutral.size(); ++code) {
+        float signal = clampUnit(code * scale.luma_scale + scale.luma_offset);
+        float light = static_cast<float>(toLinear(signal));
+        neutral[code] = static_cast<float>(255.0 * std::pow(clampUnit(light * toneScale(light)), 1.0 / 2.2));
+    }
+
+    table_transfer = transfer;
+    table_depth = depth;
+    table_full_range = full_range;
+}
+
+void ToneMapper::setMatrices(const AVFrame* frame) {
+    // HDR video is BT.2020 unless it says otherwise
+    float kr = 0.2627f;
+    float kb = 0.0593f;
+    if (frame->colorspace == AVCOL_SPC_BT709) {
+        kr = 0.2126f;
+        kb = 0.0722f;
+    } else if (frame->colorspace == AVCOL_SPC_BT470BG) {
+        kr = 0.299f;
+        kb = 0.114f;
+    }
+    float kg = 1.0f - kr - kb;
+    cr_r = 2.0f * (1.0f - kr);
+    cb_b = 2.0f * (1.0f - kb);
+    cb_g = -2.0f * kb * (1.0f - kb) / kg;
+    cr_g = -2.0f * kr * (1.0f - kr) / kg;
+
+    const float* matrix = frame->color_primaries == AVCOL_PRI_BT709 ? IDENTITY : BT2020_TO_BT709;
+    std::copy(matrix, matrix + 9, gamut);
+}
+
+// The arithmetic passes are plain loops over the block buffers which the
+// compiler vectorizes, the table lookups are kept in passes of their own
+void ToneMapper::mapBlocks(int count, uint8_t* out_u, uint8_t* out_v) {
+    const float* luma = luma_row.data();
+    const float* cb = cb_row.data();
+    const float* cr = cr_row.data();
+    float* r = red.data();
+    float* g = green.data();
+    float* b = blue.data();
+    float* mapped_luma = block_luma.data();
+    // Locals, the stores to the buffers could otherwise alias the members
+    const float red_cr = cr_r, green_cb = cb_g, green_cr = cr_g, blue_cb = cb_b;
+    float m[9];
+    std::copy(gamut, gamut + 9, m);
+
+    // YCbCr to R'G'B'
+    for (int x = 0; x < count; ++x) {
+        float y = luma[x];
+        float u = cb[x];
+        float v = cr[x];
+        r[x] = clampUnit(y + red_cr * v);
+        g[x] = clampUnit(y + green_cb * u + green_cr * v);
+        b[x] = clampUnit(y + blue_cb * u);
+    }
+
+    const float* to_linear = eotf.data();
+    for (int x = 0; x < count; ++x) {
+        r[x] = to_linear[tableIndex(r[x])];
+        g[x] = to_linear[tableIndex(g[x])];
+        b[x] = to_linear[tableIndex(b[x])];
+    }
+
+    // Gamut conversion and tone curve on the luminance, which keeps the hue
+    for (int x = 0; x < count; ++x) {
+        float lr = m[0] * r[x] + m[1] * g[x] + m[2] * b[x];
+        float lg = m[3] * r[x] + m[4] * g[x] + m[5] * b[x];
+        float lb = m[6] * r[x] + m[7] * g[x] + m[8] * b[x];
+        float scale = toneScale(0.2126f * lr + 0.7152f * lg + 0.0722f * lb);
+        r[x] = clampUnit(lr * scale);
+        g[x] = clampUnit(lg * scale);
+        b[x] = clampUnit(lb * scale);
+    }
+
+    const float* to_gamma = gamma.data();
+    for (int x = 0; x < count; ++x) {
+        r[x] = to_gamma[tableIndex(std::sqrt(r[x]))];
+        g[x] = to_gamma[tableIndex(std::sqrt(g[x]))];
+        b[x] = to_gamma[tableIndex(std::sqrt(b[x]))];
+    }
+
+    // Full range BT.601 as in JFIF
+    for (int x = 0; x < count; ++x) {
+        mapped_luma[x] = 255.0f * (0.299f * r[x] + 0.587f * g[x] + 0.114f * b[x]);
+    }
+    for (int x = 0; x < count; ++x) {
+        out_u[x] = toByte(128.0f + 255.0f * (-0.168736f * r[x] - 0.331264f * g[x] + 0.5f * b[x]));
+    }
+    for (int x = 0; x < count; ++x) {
+        out_v[x] = toByte(128.0f + 255.0f * (0.5f * r[x] - 0.418688f * g[x] - 0.081312f * b[x]));
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef TONE_MAPPING_H
+#define TONE_MAPPING_H
+
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+enum class Transfer {
+    Sdr,
+    Pq,   // SMPTE ST 2084, HDR10
+    Hlg   // ARIB STD-B67, broadcast HDR
+};
+
+Transfer frameTransfer(const AVFrame* frame);
+
+// True for frames the MJPEG encoder cannot take as they are, i.e. with more
+// than 8 bits per component or an HDR transfer function
+bool needsScreenshotConversion(const AVFrame* frame);
+
+// Converts high bit depth and HDR frames to 8-bit full range YUV 4:2:0 with
+// the BT.601 matrix JPEG viewers assume. SDR frames only lose bit depth in
+// swscale. PQ and HLG frames are decoded to linear light, mapped from the
+// BT.2020 to the BT.709 gamut, compressed above a knee so highlights up to
+// the nominal peak stay visible and encoded with a 2.2 gamma.
+//
+// The colour pipeline runs once per 2x2 block, at chroma resolution. Each
+// pixel gets the mapped luma of the block plus the difference its own luma
+// code makes on the curve of neutral grey, a single table lookup.
+class ToneMapper {
+public:
+    ToneMapper();
+    ~ToneMapper();
+
+    // Returns the converted frame, owned by the mapper and valid until the
+    // next call, or nullptr on errors
+    AVFrame* convert(const AVFrame* frame);
+
+private:
+    AVFrame* output = nullptr;  // 8-bit full range YUV 4:2:0
+    AVFrame* wide = nullptr;    // 16-bit YUV 4:2:0 for formats the mapper cannot read directly
+    SwsContext* sdr_ctx = nullptr;
+    SwsContext* wide_ctx = nullptr;
+
+    // Tables rebuilt when transfer, bit depth or range change: signal to
+    // linear light, linear light to gamma and the mapped luma of neutral
+    // grey for every luma code
+    Transfer table_transfer = Transfer::Sdr;
+    int table_depth = 0;
+    bool table_full_range = false;
+    std::vector<float> eotf;
+    std::vector<float> gamma;
+    std::vector<float> neutral;
+
+    // YCbCr to R'G'B' and gamut conversion of the current frame
+    float cr_r = 0.0f, cb_g = 0.0f, cr_g = 0.0f, cb_b = 0.0f;
+    float gamut[9] = {};
+
+    // One entry per 2x2 block of a row pair: mean luma code, signal values,
+    // linear light and the mapped luma
+    std::vector<float> block_code, luma_row, cb_row, cr_row, red, green, blue, block_luma;
+
+    AVFrame* convertSdr(const AVFrame* frame);
+    AVFrame* toneMap(const AVFrame* frame, Transfer transfer);
+    void buildTables(Transfer transfer, int depth, bool full_range);
+    void setMatrices(const AVFrame* frame);
+    void mapBlocks(int count, uint8_t* out_u, uint8_t* out_v);
+};
+
+#endif
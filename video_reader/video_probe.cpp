@@ -0,0 +1,214 @@
+#include "video_probe.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/dict.h>
+}
+
+namespace {
+
+const size_t MAX_CACHE_ENTRIES = 4096;
+
+std::mutex cacheMutex;
+std::map<std::string, VideoInfo> cache;
+
+// Key that changes whenever the file is replaced or modified. Empty if the
+// file cannot be stat'ed, e.g. for URLs, in which case nothing is cached.
+std::string fileIdentity(const std::string& path) {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0) {
+        return "";
+    }
+    uint64_t inode = 0;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return "";
+    }
+    uint64_t inode = static_cast<uint64_t>(st.st_ino);
+#endif
+    return path + '\n' + std::to_string(static_cast<int64_t>(st.st_size)) + ':' +
+           std::to_string(static_cast<int64_t>(st.st_mtime)) + ':' + std::to_string(inode);
+}
+
+// Matroska files muxed by mkvmerge carry the frame count as a tag
+int64_t taggedFrameCount(const AVStream* stream) {
+    const AVDictionaryEntry* tag = av_dict_get(stream->metadata, "NUMBER_OF_FRAMES", nullptr, AV_DICT_IGNORE_SUFFIX);
+    return tag ? std::max<int64_t>(0, strtoll(tag->value, nullptr, 10)) : 0;
+}
+
+// Indexes of e.g. AVI list every frame, the cues of Matroska only keyframes.
+// An index with at least one non-keyframe is taken as complete.
+int64_t indexedFrameCount(AVStream* stream) {
+    int entries = avformat_index_get_entries_count(stream);
+    for (int i = 0; i < entries; ++i) {
+        const AVIndexEntry* entry = avformat_index_get_entry(stream, i);
+        if (entry && !(entry->flags & AVINDEX_KEYFRAME)) {
+            return entries;
+        }
+    }
+    return 0;
+}
+
+// Reads every packet of the video stream without decoding it. Also
+// estimates the frame rate from the timestamps if the headers lack it.
+int64_t countPackets(AVFormatContext* format_ctx, int video_stream_index, double& fps) {
+    for (unsigned int i = 0; i < format_ctx->nb_streams; ++i) {
+        if (static_cast<int>(i) != video_stream_index) {
+            format_ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    AVPacket* packet = av_packet_alloc();
+    if (!packet) {
+        return 0;
+    }
+    int64_t count = 0;
+    int64_t first = AV_NOPTS_VALUE;
+    int64_t last = AV_NOPTS_VALUE;
+    while (av_read_frame(format_ctx, packet) >= 0) {
+        if (packet->stream_index == video_stream_index) {
+            count++;
+            if (packet->pts != AV_NOPTS_VALUE) {
+                first = first == AV_NOPTS_VALUE ? packet->pts : std::min(first, packet->pts);
+                last = last == AV_NOPTS_VALUE ? packet->pts + packet->duration
+                                              : std::max(last, packet->pts + packet->duration);
+            }
+        }
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+
+    if (fps <= 0.0 && count > 0 && first != AV_NOPTS_VALUE && last > first) {
+        fps = count / ((last - first) * av_q2d(format_ctx->streams[video_stream_index]->time_base));
+    }
+    return count;
+}
+
+bool probeFile(const std::string& path, VideoInfo& info, const ProbeOptions& options) {
+    AVFormatContext* format_ctx = avformat_alloc_context();
+    if (!format_ctx) {
+        return false;
+    }
+    format_ctx->probesize = options.probeSize;
+    format_ctx->max_analyze_duration = options.analyzeDuration;
+    if (avformat_open_input(&format_ctx, path.c_str(), nullptr, nullptr) < 0) {
+        return false;
+    }
+
+    int video_stream_index = -1;
+    for (unsigned int i = 0; i < format_ctx->nb_streams; ++i) {
+        if (format_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            video_stream_index = static_cast<int>(i);
+            break;
+        }
+    }
+    if (video_stream_index < 0) {
+        avformat_close_input(&format_ctx);
+        return false;
+    }
+
+    AVStream* stream = format_ctx->streams[video_stream_index];
+    if (stream->codecpar->width <= 0 || stream->codecpar->height <= 0) {
+        avformat_find_stream_info(format_ctx, nullptr);
+    }
+
+    info.fps = streamFrameRate(stream);
+    info.width = stream->codecpar->width;
+    info.height = stream->codecpar->height;
+
+    int64_t frames = stream->nb_frames;
+    if (frames <= 0) {
+        frames = taggedFrameCount(stream);
+    }
+    if (frames <= 0) {
+        frames = indexedFrameCount(stream);
+    }
+    if (frames <= 0 && options.countPackets) {
+        frames = countPackets(format_ctx, video_stream_index, info.fps);
+    }
+    info.numFrames = static_cast<double>(frames);
+
+    avformat_close_input(&format_ctx);
+    return info.width > 0 && info.height > 0;
+}
+
+}  // namespace
+
+double streamFrameRate(const AVStream* stream) {
+    if (stream->avg_frame_rate.num > 0 && stream->avg_frame_rate.den > 0) {
+        return av_q2d(stream->avg_frame_rate);
+    }
+    if (stream->r_frame_rate.num > 0 && stream->r_frame_rate.den > 0) {
+        return av_q2d(stream->r_frame_rate);
+    }
+    return 0.0;
+}
+
+bool probeVideo(const std::string& path, VideoInfo& info, const ProbeOptions& options) {
+    std::string key = options.useCache ? fileIdentity(path) : "";
+    if (!key.empty()) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = cache.find(key);
+        if (it != cache.end()) {
+            info = it->second;
+            return true;
+        }
+    }
+
+    if (!probeFile(path, info, options)) {
+        return false;
+    }
+
+    if (!key.empty()) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        if (cache.size() >= MAX_CACHE_ENTRIES) {
+            cache.clear();
+        }
+        cache[key] = info;
+    }
+    return true;
+}
+
+std::vector<ProbeResult> probeVideos(const std::vector<std::string>& paths, int threads,
+                                     const ProbeOptions& options) {
+    std::vector<ProbeResult> results(paths.size());
+    if (threads <= 0) {
+        threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    threads = std::min<int>(threads, static_cast<int>(paths.size()));
+
+    std::atomic<size_t> next{0};
+    auto work = [&]() {
+        for (size_t i = next++; i < paths.size(); i = next++) {
+            results[i].path = paths[i];
+            results[i].ok = probeVideo(paths[i], results[i].info, options);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; ++i) {
+        pool.emplace_back(work);
+    }
+    work();
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    return results;
+}
+
+void clearProbeCache() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache.clear();
+}
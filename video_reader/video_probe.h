@@ -0,0 +1,53 @@
+#ifndef VIDEO_PROBE_H
+#define VIDEO_PROBE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct AVStream;
+
+struct VideoInfo {
+    double fps = 0.0;
+    double width = 0.0;
+    double height = 0.0;
+    double numFrames = 0.0;
+};
+
+struct ProbeOptions {
+    int64_t probeSize = 1 << 20;        // Bytes the format detection may read
+    int64_t analyzeDuration = 1000000;  // Microseconds of the file the format detection may read
+    bool countPackets = true;           // Count the packets if neither header nor index knows the frame count
+    bool useCache = true;
+};
+
+struct ProbeResult {
+    std::string path;
+    bool ok = false;
+    VideoInfo info;
+};
+
+// Reads frame rate, size and frame count of the first video stream from the
+// container without opening a decoder. The frame count comes from the header,
+// a Matroska statistics tag or an index listing every frame, otherwise the
+// video packets are counted, which reads but does not decode the whole file.
+// Only if the headers lack the frame size, as for raw elementary streams,
+// FFmpeg's stream analysis is run within probeSize and analyzeDuration.
+//
+// Results are cached per path, size and modification time of the file.
+bool probeVideo(const std::string& path, VideoInfo& info, const ProbeOptions& options = ProbeOptions());
+
+// Probes the files on up to threads threads, hardware threads if threads <= 0.
+// The results are in the order of paths.
+std::vector<ProbeResult> probeVideos(const std::vector<std::string>& paths, int threads = 0,
+                                     const ProbeOptions& options = ProbeOptions());
+
+void clearProbeCache();
+
+// Frame rate reported by probeVideo and VideoReader::getFrameRate. The
+// average rate comes first as it turns frame numbers into times for variable
+// frame rate files too, r_frame_rate is at least as high and is only used if
+// the container gives no average. 0 if neither is known.
+double streamFrameRate(const AVStream* stream);
+
+#endif
@@ -1,11 +1,17 @@
 #include "video_reader.h"
+#include "screenshot_archive.h"
+#include "shot_model.h"
+#include "video_probe.h"
 using namespace std;
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstring>
 #include <csignal>
-#include <iomanip>
 #include <iostream>
-#include <sstream>
+#include <mutex>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <chrono>
@@ -20,13 +26,17 @@ extern "C" {
 
 #include <onnxruntime_cxx_api.h>
 
-std::atomic<bool> VideoReader::cancelled(false);
+std::atomic<unsigned> VideoReader::cancel_generation(0);
 
 
 VideoReader::VideoReader(const std::string& file_path) : file_path(file_path) {
-    setCancelled(false);
-    signal(SIGTERM, VideoReader::signalHandler);
-    signal(SIGINT, VideoReader::signalHandler);
+    // Installed by the first reader only. A signal cancels the operations
+    // running at that moment, see cancelAll().
+    static std::once_flag handlers;
+    std::call_once(handlers, []() {
+        signal(SIGTERM, VideoReader::signalHandler);
+        signal(SIGINT, VideoReader::signalHandler);
+    });
     last_fps_report_time = std::chrono::high_resolution_clock::now();
 }
 
@@ -40,9 +50,15 @@ VideoReader::~VideoReader() {
     if (frame) {
         av_frame_free(&frame);
     }
-    if (file) {
-      fclose(file);
-    }
+    av_frame_free(&prev_frame);
+    av_frame_free(&thumb_frame);
+    av_packet_free(&packet);
+    sws_freeContext(scale_ctx);
+    sws_freeContext(thumb_scale_ctx);
+    avcodec_free_context(&jpeg_full.ctx);
+    av_packet_free(&jpeg_full.packet);
+    avcodec_free_context(&jpeg_mini.ctx);
+    av_packet_free(&jpeg_mini.packet);
     if (parser) {
       av_parser_close(parser);
     }
@@ -50,11 +66,33 @@ VideoReader::~VideoReader() {
 
 void VideoReader::signalHandler(int signum) {
     std::cout << "Received signal " << signum << ". Terminating gracefully..." << std::endl;
-    setCancelled(true);
+    cancelAll();
+}
+
+
+void VideoReader::setIoOptions(const IoOptions& options) {
+    io_options = options;
+}
+
+void VideoReader::setAudioOptions(const AudioOptions& options) {
+    audio_options = options;
 }
 
+const AudioAnalysis& VideoReader::getAudioAnalysis() const {
+    return audio_analysis;
+}
 
 bool VideoReader::Open() {
+    io_source = MediaSource::open(file_path, io_options);
+    if (io_source) {
+        format_ctx = avformat_alloc_context();
+        if (!format_ctx) {
+            return false;
+        }
+        format_ctx->pb = io_source->context();
+        format_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+
     if (avformat_open_input(&format_ctx, file_path.c_str(), nullptr, nullptr) < 0) {
         return false;
     }
@@ -74,6 +112,21 @@ bool VideoReader::Open() {
         return false;
     }
 
+    // A missing or undecodable audio stream only disables the audio analysis
+    if (audio_options.enabled) {
+        int audio_stream_index = av_find_best_stream(format_ctx, AVMEDIA_TYPE_AUDIO, -1, video_stream_index, nullptr, 0);
+        if (audio_stream_index >= 0) {
+            const AVStream* video_stream = format_ctx->streams[video_stream_index];
+            double origin = video_stream->start_time == AV_NOPTS_VALUE
+                          ? 0.0 : video_stream->start_time * av_q2d(video_stream->time_base);
+            audio = std::make_unique<AudioAnalyzer>();
+            if (!audio->open(format_ctx->streams[audio_stream_index], audio_options, origin)) {
+                std::cerr << "Audio stream of " << file_path << " cannot be decoded" << std::endl;
+                audio.reset();
+            }
+        }
+    }
+
     AVCodecParameters* codec_params = format_ctx->streams[video_stream_index]->codecpar;
     const AVCodec* codec = avcodec_find_decoder(codec_params->codec_id);
     if (!codec) {
@@ -103,15 +156,25 @@ bool VideoReader::Open() {
       return false;
     }
 
-    file = fopen(file_path.c_str(), "rb");
-    if (!file) {
+    // Frames and packets reused by all decode loops
+    prev_frame = av_frame_alloc();
+    packet = av_packet_alloc();
+    thumb_frame = av_frame_alloc();
+    if (!prev_frame || !packet || !thumb_frame) {
         return false;
     }
+    thumb_frame->width = 48;
+    thumb_frame->height = 27;
+    thumb_frame->format = AV_PIX_FMT_YUV420P;
+    if (av_frame_get_buffer(thumb_frame, 0) < 0) {
+        return false;
+    }
+    path_buffer.reserve(4096);
     return true;
   }
 
 double VideoReader::getFrameRate() {
-    return av_q2d(format_ctx->streams[video_stream_index]->r_frame_rate);
+    return streamFrameRate(format_ctx->streams[video_stream_index]);
 }
 
 double VideoReader::getHeight() {
@@ -126,216 +189,348 @@ double VideoReader::getNumFrames() {
     return format_ctx->streams[video_stream_index]->nb_frames;
 }
 
-std::vector<uint8_t>& VideoReader::ReadNextFrame(std::vector<uint8_t>& out_frame_data) {
-    AVPacket packet;
+bool VideoReader::ReadNextFrame(uint8_t* out_frame_data, int width, int height, AVPixelFormat pix_fmt) {
     int response;
 
-    while (av_read_frame(format_ctx, &packet) >= 0) {
-        if (packet.stream_index == video_stream_index) {
-            response = avcodec_send_packet(codec_ctx, &packet);
+    while (readPacket(packet) >= 0) {
+        if (packet->stream_index == video_stream_index) {
+            response = sendPacket(packet);
             if (response < 0) {
-                av_packet_unref(&packet);
+                av_packet_unref(packet);
                 finished = true;
-                return out_frame_data;
+                return false;
             }
 
-            response = avcodec_receive_frame(codec_ctx, frame);
+            response = receiveFrame(frame);
             if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
-                av_packet_unref(&packet);
+                av_packet_unref(packet);
                 continue;
             } else if (response < 0) {
-                av_packet_unref(&packet);
+                av_packet_unref(packet);
                 finished = true;
-                return out_frame_data;
+                return false;
             }
 
-            // Update frame counter and report FPS
-            frame_counter++;
-            if (frame_counter % FPS_REPORT_INTERVAL == 0) {
-                auto current_time = std::chrono::high_resolution_clock::now();
-                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(current_time - last_fps_report_time).count();
-                double current_fps = (FPS_REPORT_INTERVAL * 1000.0) / elapsed;  // Convert to frames per second
-                fprintf(stderr, "Processing frame %lld, Measured FPS: %.2f\n", frame_counter, current_fps);
-                last_fps_report_time = current_time;
-            }
+            countFrame();
 
-            // TODO get cache sws context?
-            SwsContext* sws_ctx = sws_getContext(
+            // The context is only recreated if the source geometry changes
+            scale_ctx = sws_getCachedContext(scale_ctx,
                 frame->width, frame->height, codec_ctx->pix_fmt,
-                48, 27, AV_PIX_FMT_RGB24,
+                width, height, pix_fmt,
                 SWS_BICUBIC, nullptr, nullptr, nullptr
             );
+            if (!scale_ctx) {
+                av_packet_unref(packet);
+                finished = true;
+                return false;
+            }
 
-            AVFrame* frame2 = av_frame_alloc();
-            int num_bytes = av_image_get_buffer_size(AV_PIX_FMT_RGB24, 48, 27, 1);
-            uint8_t* frame2_buffer = (uint8_t*)av_malloc(num_bytes);
-
-            av_image_fill_arrays(frame2->data, frame2->linesize, frame2_buffer, AV_PIX_FMT_RGB24, 48, 27, 1);
-            sws_scale(sws_ctx, frame->data, frame->linesize, 0, frame->height, frame2->data, frame2->linesize);
-
-            for (int y = 0; y < 27; ++y) {
-                uint8_t* row_ptr = frame2->data[0] + y * frame2->linesize[0];
-                out_frame_data.insert(out_frame_data.end(), row_ptr, row_ptr + (48 * 3)); // 48 pixels * 3 bytes (RGB)
+            // Scale straight into the caller's buffer with packed rows
+            uint8_t* dst[4] = {out_frame_data, nullptr, nullptr, nullptr};
+            int dst_linesize[4] = {width * (pix_fmt == AV_PIX_FMT_GRAY8 ? 1 : 3), 0, 0, 0};
+            {
+                ScopedStage timer(metrics, Stage::Scale);
+                sws_scale(scale_ctx, frame->data, frame->linesize, 0, frame->height, dst, dst_linesize);
             }
 
-            av_free(frame2_buffer);
-            av_frame_free(&frame2);
-            sws_freeContext(sws_ctx);
-            av_packet_unref(&packet);
+            av_packet_unref(packet);
             finished = false;
-            return out_frame_data;
+            return true;
+        } else if (audio && packet->stream_index == audio->streamIndex()) {
+            ScopedStage timer(metrics, Stage::Audio);
+            audio->addPacket(packet);
         }
-        av_packet_unref(&packet);
+        av_packet_unref(packet);
     }
 
     finished = true;
-    return out_frame_data;
+    return false;
 }
 
 bool VideoReader::Done() const {
     return finished;
 }
 
+int VideoReader::readPacket(AVPacket* packet) {
+    ScopedStage timer(metrics, Stage::Demux);
+    return av_read_frame(format_ctx, packet);
+}
 
-std::vector<std::vector<int>> VideoReader::DetectShots(const std::string& onnx_model_path) {
-    std::vector<std::vector<int>> shots;
-    std::vector<float> allPredictions;
+int VideoReader::sendPacket(const AVPacket* packet) {
+    ScopedStage timer(metrics, Stage::PacketSend);
+    return avcodec_send_packet(codec_ctx, packet);
+}
+
+int VideoReader::receiveFrame(AVFrame* out) {
+    ScopedStage timer(metrics, Stage::Decode);
+    return avcodec_receive_frame(codec_ctx, out);
+}
+
+MetricsSnapshot VideoReader::getMetrics() const {
+    MetricsSnapshot snapshot = metrics.snapshot();
+    if (io_source) {
+        snapshot.io = io_source->stats();
+    }
+    return snapshot;
+}
+
+void VideoReader::resetMetrics() {
+    metrics.reset();
+    if (io_source) {
+        io_source->resetStats();
+    }
+}
+
+void VideoReader::setTracing(bool enabled) {
+    metrics.setTracing(enabled);
+}
+
+bool VideoReader::writeTrace(const std::string& path) const {
+    return metrics.writeChromeTrace(path);
+}
+
+void VideoReader::resetProgress(ProgressCallback onProgress) {
+    // Called at the start of every operation, a cancel only stops the running one
+    stop_requested = false;
+    operation_generation = cancel_generation.load();
+    last_status = OperationStatus::Ok;
+    last_error.clear();
+    progress_callback = std::move(onProgress);
+    frame_counter = 0;
+    last_fps_report_time = std::chrono::high_resolution_clock::now();
+}
+
+void VideoReader::failOperation(const std::string& message) {
+    std::cerr << message << std::endl;
+    last_status = OperationStatus::Failed;
+    last_error = message;
+}
+
+bool VideoReader::finishOperation() {
+    progress_callback = nullptr;
+    if (last_status == OperationStatus::Ok && stopRequested()) {
+        last_status = OperationStatus::Cancelled;
+    }
+    return last_status == OperationStatus::Ok;
+}
+
+void VideoReader::countFrame() {
+    frame_counter++;
+    if (frame_counter % FPS_REPORT_INTERVAL != 0) {
+        return;
+    }
+
+    auto current_time = std::chrono::high_resolution_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(current_time - last_fps_report_time).count();
+    double current_fps = (FPS_REPORT_INTERVAL * 1000.0) / std::max<int64_t>(elapsed, 1);  // Convert to frames per second
+    fprintf(stderr, "Processing frame %lld, Measured FPS: %.2f\n", (long long)frame_counter, current_fps);
+    last_fps_report_time = current_time;
+
+    // No progress once stopped, a host must not report a cancelled operation as running
+    if (progress_callback && !stopRequested()) {
+        ProgressInfo info;
+        info.framesDone = frame_counter;
+        info.totalFrames = static_cast<int64_t>(getNumFrames());
+        info.fps = current_fps;
+        if (info.totalFrames > info.framesDone && current_fps > 0) {
+            info.eta = (info.totalFrames - info.framesDone) / current_fps;
+        }
+        progress_callback(info);
+    }
+}
+
+
+std::vector<std::vector<int>> VideoReader::DetectShots(const std::string& onnx_model_path,
+                                                       ProgressCallback onProgress,
+                                                       ShotCallback onShot) {
+    try {
+        ShotModel model(onnx_model_path);
+        return DetectShots(model, std::move(onProgress), std::move(onShot));
+    } catch (const Ort::Exception& exception) {
+        failOperation(std::string("ONNX Runtime error: ") + exception.what());
+    } catch (const std::runtime_error& exception) {
+        failOperation(std::string("Shot detection error: ") + exception.what());
+    }
+    return {};
+}
+
+std::vector<std::vector<int>> VideoReader::DetectShots(ShotModel& model,
+                                                       ProgressCallback onProgress,
+                                                       ShotCallback onShot) {
+    // Shots are collected as pairs and only turned into the returned vectors
+    // at the end, so the decode loop does not allocate per shot
+    std::vector<std::array<int, 2>> shotBounds;
+    shotBounds.reserve(getNumFrames() > 0 ? static_cast<size_t>(getNumFrames()) / 2 + 1 : 4096);
+    // Predictions not consumed yet, the first one belongs to frame predictionBase
+    std::vector<float> predictions;
+    size_t predictionBase = 0;
 
     finished = false;
-    cancelled = false;
+    resetProgress(std::move(onProgress));
+    audio_analysis = AudioAnalysis();
+    if (audio) {
+        audio->reset();
+    }
+
+    // Shot boundary state, advanced whenever new predictions become available
+    size_t nextPrediction = 0;
+    int start = 0;
+    int prevState = 0;
+    auto consumePredictions = [&](size_t limit) {
+        for (; nextPrediction < limit; ++nextPrediction) {
+            int currState = predictions[nextPrediction - predictionBase] > model.descriptor().threshold ? 1 : 0;
+            int i = static_cast<int>(nextPrediction);
+
+            if (prevState == 1 && currState == 0) {
+                start = i;
+            }
+
+            if (prevState == 0 && currState == 1 && i != 0) {
+                shotBounds.push_back({{start, i}});
+                if (onShot) {
+                    onShot(start, i);
+                }
+            }
+
+            prevState = currState;
+        }
+        predictions.erase(predictions.begin(), predictions.begin() + (nextPrediction - predictionBase));
+        predictionBase = nextPrediction;
+    };
 
     try {
-        // ONNX Runtime setup
-        Ort::Env env(ORT_LOGGING_LEVEL_WARNING, "shot_detection");
-        Ort::SessionOptions session_options;
-        // session_options.SetIntraOpNumThreads(1);
-        #ifdef _WIN32
-            std::wstring wide_path(onnx_model_path.begin(), onnx_model_path.end());
-            Ort::Session session(env, wide_path.c_str(), session_options);
-        #else
-            Ort::Session session(env, onnx_model_path.c_str(), session_options);
-        #endif
-
-        // Inference parameters
-        const int inputWidth = 48;
-        const int inputHeight = 27;
-        const int inputChannels = 3;
-        const int sequenceLength = 100;
-        const int stepSize = 50;
-        const int paddingStart = 25;
-
-        // Sliding window management
-        std::vector<std::vector<uint8_t>> frameWindow;
+        // Geometry, normalization and windowing of the model
+        const ModelDescriptor& descriptor = model.descriptor();
+        const size_t sequenceLength = descriptor.sequenceLength;
+        const size_t stepSize = descriptor.step;
+        const int paddingStart = descriptor.padding;
+        const AVPixelFormat inputFormat = descriptor.channelOrder == ChannelOrder::Gray ? AV_PIX_FMT_GRAY8
+                                        : descriptor.channelOrder == ChannelOrder::Bgr ? AV_PIX_FMT_BGR24
+                                        : AV_PIX_FMT_RGB24;
+        const Preprocessor preprocess(descriptor);
+
+        const size_t frameBytes = descriptor.frameBytes();
+        const std::vector<int64_t> inputShape = descriptor.inputShape();
+        const size_t requiredOutputs = static_cast<size_t>(descriptor.outputEnd) * descriptor.outputChannels;
+
+        // Sliding window arena and tensor buffers, allocated once per run
+        std::vector<uint8_t> frameWindow(sequenceLength * frameBytes);
+        size_t windowFrames = 0;
+        // Quantized models take the frame window as it is, no float tensor needed
+        const bool feedBytes = model.takesBytes();
+        std::vector<float> inputData(feedBytes ? 0 : sequenceLength * frameBytes);
+        std::vector<float> outputData;
+        predictions.reserve(2 * sequenceLength);
         unsigned long frameCounter = 1;
 
         // Initial padding setup
-        std::vector<uint8_t> frameData;
-        ReadNextFrame(frameData);
-        for (int i = 0; i <= paddingStart; ++i) {
-            frameWindow.push_back(frameData);
+        ReadNextFrame(frameWindow.data(), descriptor.width, descriptor.height, inputFormat);
+        for (int i = 1; i <= paddingStart; ++i) {
+            memcpy(&frameWindow[i * frameBytes], frameWindow.data(), frameBytes);
         }
+        windowFrames = paddingStart + 1;
 
         // Process video in chunks
-        while (!Done() && !isCancelled()) {
+        while (!Done() && !stopRequested()) {
             // Collect frames for the current window
-            while(frameWindow.size() < sequenceLength && !Done()) {
-                std::vector<uint8_t> frameData;
-                ReadNextFrame(frameData);
+            while(windowFrames < sequenceLength && !Done()) {
+                bool decoded = ReadNextFrame(&frameWindow[windowFrames * frameBytes],
+                                             descriptor.width, descriptor.height, inputFormat);
                 frameCounter++;
-                if (!frameData.empty()) {
-                    frameWindow.push_back(frameData);
+                if (decoded) {
+                    windowFrames++;
                 }
             }
 
             // Add end padding if we're at the end of the video
-            while(frameWindow.size() < sequenceLength && Done()) {
-                frameWindow.push_back(frameWindow.back());
+            while(windowFrames < sequenceLength && Done()) {
+                memcpy(&frameWindow[windowFrames * frameBytes], &frameWindow[(windowFrames - 1) * frameBytes], frameBytes);
+                windowFrames++;
             }
 
             // Process current window if large enough
-            if (frameWindow.size() >= sequenceLength) {
+            if (windowFrames >= sequenceLength) {
                 // Prepare input tensor
-                std::vector<float> inputData;
-                inputData.reserve(sequenceLength * inputWidth * inputHeight * inputChannels);
-
-                for (size_t i = 0; i < sequenceLength; ++i) {
-                    for (size_t j = 0; j < inputWidth * inputHeight * inputChannels; ++j) {
-                        inputData.push_back(frameWindow[i][j]);
-                    }
+                metrics.setQueueDepth(Queue::FrameWindow, windowFrames);
+                if (!feedBytes) {
+                    ScopedStage timer(metrics, Stage::TensorPrep);
+                    preprocess(frameWindow.data(), inputData.data());
                 }
 
-                // Create ONNX tensor
-                std::vector<int64_t> inputShape = {1, 100, 27, 48, 3};
-                Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(
-                    OrtArenaAllocator, OrtMemTypeDefault);
-                Ort::Value inputTensor = Ort::Value::CreateTensor<float>(
-                    memoryInfo, inputData.data(), inputData.size(), inputShape.data(), inputShape.size());
-
-                // Prepare input feeds
-                std::vector<const char*> inputNames = {"input"};
-                std::vector<const char*> outputNames = {"534"};
-
                 // Run inference
-                auto outputTensors = session.Run(Ort::RunOptions{nullptr},
-                                                inputNames.data(), &inputTensor, 1,
-                                                outputNames.data(), 1);
-
-                // Extract predictions (25 to 75 indices for the current window)
-                float* rawResult = outputTensors[0].GetTensorMutableData<float>();
-                std::vector<float> windowPredictions(rawResult + 25, rawResult + 75);
+                {
+                    ScopedStage timer(metrics, Stage::Inference);
+                    if (feedBytes) {
+                        model.run(frameWindow.data(), frameWindow.size(), inputShape, outputData);
+                    } else {
+                        model.run(inputData, inputShape, outputData);
+                    }
+                }
+                if (outputData.size() < requiredOutputs) {
+                    throw std::runtime_error("Model output is smaller than the descriptor's output slice");
+                }
 
-                // Append to overall predictions
-                allPredictions.insert(allPredictions.end(),
-                                    windowPredictions.begin(),
-                                    windowPredictions.end());
+                // Append the predictions of the output slice of the current window
+                for (int i = descriptor.outputStart; i < descriptor.outputEnd; ++i) {
+                    predictions.push_back(descriptor.score(outputData.data(), i));
+                }
 
                 // Slide the window
-                frameWindow.erase(frameWindow.begin(), frameWindow.begin() + stepSize);
-            }
-        }
+                memmove(frameWindow.data(), &frameWindow[stepSize * frameBytes],
+                        (windowFrames - stepSize) * frameBytes);
+                windowFrames -= stepSize;
+                metrics.setQueueDepth(Queue::FrameWindow, windowFrames);
 
-        // Convert predictions to shot boundaries
-        std::vector<int> binaryPredictions;
-        for (size_t i=0; i <= frameCounter; i++) {
-            binaryPredictions.push_back(allPredictions[i] > 0.5 ? 1 : 0);
-        }
-
-        // Find shot boundaries
-        int start = 0;
-        int prevState = 0;
-        for (size_t i = 0; i < binaryPredictions.size(); ++i) {
-            int currState = binaryPredictions[i];
-
-            if (prevState == 1 && currState == 0) {
-                start = i;
+                // Predictions of frames that were already read are final
+                consumePredictions(std::min<size_t>(predictionBase + predictions.size(), frameCounter + 1));
             }
-
-            if (prevState == 0 && currState == 1 && i != 0) {
-                shots.push_back({start, static_cast<int>(i)});
-            }
-
-            prevState = currState;
         }
 
+        consumePredictions(std::min<size_t>(predictionBase + predictions.size(), frameCounter + 1));
+        const int lastFrame = static_cast<int>(frameCounter);
+
         // Handle last shot if needed
         if (prevState == 0) {
-            shots.push_back({start, static_cast<int>(binaryPredictions.size() - 1)});
+            shotBounds.push_back({{start, lastFrame}});
+            if (onShot) {
+                onShot(start, lastFrame);
+            }
         }
 
         // If no shots detected, return full video as a single shot
-        if (shots.empty()) {
-            shots.push_back({0, static_cast<int>(binaryPredictions.size() - 1)});
+        if (shotBounds.empty()) {
+            shotBounds.push_back({{0, lastFrame}});
+            if (onShot) {
+                onShot(0, lastFrame);
+            }
         }
 
     } catch (const Ort::Exception& exception) {
-        std::cerr << "ONNX Runtime error: " << exception.what() << std::endl;
+        failOperation(std::string("ONNX Runtime error: ") + exception.what());
+    } catch (const std::runtime_error& exception) {
+        failOperation(std::string("Shot detection error: ") + exception.what());
+    }
+
+    // A truncated shot list must not pass for a complete one
+    if (!finishOperation()) {
+        return {};
+    }
+
+    std::vector<std::vector<int>> shots;
+    shots.reserve(shotBounds.size());
+    for (const std::array<int, 2>& bounds : shotBounds) {
+        shots.push_back({bounds[0], bounds[1]});
     }
 
+    if (audio) {
+        ScopedStage timer(metrics, Stage::Audio);
+        audio->flush();
+        audio_analysis = audio->result(shots, getFrameRate());
+    }
     return shots;
 }
 
 int VideoReader::generateScreenshot(const std::string& directory, int frame_num) {
-    AVPacket packet;
     int response;
     AVRational fr;
     AVRational tb;
@@ -343,7 +538,6 @@ int VideoReader::generateScreenshot(const std::string& directory, int frame_num)
     int64_t target;
     int64_t target_jump;
     bool has_prev = false;
-    AVFrame* prevframe = av_frame_alloc();
     int64_t ts;
 
     frame_num_jump = frame_num - 100;
@@ -359,206 +553,355 @@ int VideoReader::generateScreenshot(const std::string& directory, int frame_num)
 
     fprintf(stderr, "Seeking to frame %d (target ts: %lld)\n", frame_num, (long long)target);
 
-    response = av_seek_frame(format_ctx, video_stream_index,
-                             target_jump, AVSEEK_FLAG_BACKWARD);
+    {
+        ScopedStage timer(metrics, Stage::Demux);
+        response = av_seek_frame(format_ctx, video_stream_index,
+                                 target_jump, AVSEEK_FLAG_BACKWARD);
+    }
     if (response < 0)
         return -1;
 
     avcodec_flush_buffers(codec_ctx);
+    av_frame_unref(prev_frame);
 
-    while (av_read_frame(format_ctx, &packet) >= 0) {
-        if (packet.stream_index == video_stream_index) {
-            if (avcodec_send_packet(codec_ctx, &packet) == 0) {
-                while (avcodec_receive_frame(codec_ctx, frame) == 0) {
+    while (readPacket(packet) >= 0) {
+        if (packet->stream_index == video_stream_index) {
+            if (sendPacket(packet) == 0) {
+                while (receiveFrame(frame) == 0) {
                     ts = frame->best_effort_timestamp;
 
                     if (ts > target && has_prev) {
                         // Use previous frame if we are passed the timestamp
                         av_frame_unref(frame);
-                        av_frame_ref(frame, prevframe);
+                        av_frame_move_ref(frame, prev_frame);
                     }
                     if (ts >= target) {
                         fprintf(stderr, "Reached target ts %lld\n", (long long)ts);
 
                         int ret = saveFrame(directory, frame_num);
-                        av_packet_unref(&packet);
-                        av_frame_free(&prevframe);
+                        av_packet_unref(packet);
+                        av_frame_unref(prev_frame);
                         return ret;
                     }
 
-                    // Store copy as previous frame
-                    av_frame_unref(prevframe);
-                    av_frame_ref(prevframe, frame);
+                    // Keep the frame as previous frame, moving the reference
+                    // leaves frame empty for the next receive without copying
+                    av_frame_unref(prev_frame);
+                    av_frame_move_ref(prev_frame, frame);
                     has_prev = true;
                 }
             }
         }
 
-        av_packet_unref(&packet);
+        av_packet_unref(packet);
     }
 
-    av_frame_free(&prevframe);
+    av_frame_unref(prev_frame);
     return -1;
 }
 
-int VideoReader::saveFrame(const std::string& directory, int frame_num) {
-    std::ostringstream path;
-    path << directory << '/' << std::setw(8) << std::setfill('0') << frame_num << ".jpg";
+const std::string& VideoReader::screenshotPath(const std::string& directory, int frame_num, const char* suffix) {
+    char name[32];
+    snprintf(name, sizeof(name), "/%08d%s.jpg", frame_num, suffix);
+    path_buffer.assign(directory);
+    path_buffer.append(name);
+    return path_buffer;
+}
 
-    if (saveFrameAsJpeg(codec_ctx->pix_fmt, frame, path.str()) < 0) {
+AVFrame* VideoReader::screenshotFrame(AVPixelFormat& pix_fmt) {
+    if (!needsScreenshotConversion(frame)) {
+        pix_fmt = codec_ctx->pix_fmt;
+        return frame;
+    }
+    ScopedStage timer(metrics, Stage::ToneMap);
+    pix_fmt = AV_PIX_FMT_YUV420P;
+    return tone_mapper.convert(frame);
+}
+
+int VideoReader::saveFrame(const std::string& directory, int frame_num) {
+    AVPixelFormat pix_fmt;
+    AVFrame* source = screenshotFrame(pix_fmt);
+    if (!source || saveFrameAsJpeg(jpeg_full, pix_fmt, source, screenshotPath(directory, frame_num, "")) < 0) {
         return -1;
     }
 
-    // Generate a mini thumbnail
-    AVPixelFormat scaled_pix_fmt = AV_PIX_FMT_YUV420P;
-    SwsContext* sws_ctx = sws_getContext(
-        frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
-        48, 27, scaled_pix_fmt,
+    // Generate a mini thumbnail into the preallocated thumbnail frame
+    thumb_scale_ctx = sws_getCachedContext(thumb_scale_ctx,
+        source->width, source->height, static_cast<AVPixelFormat>(source->format),
+        48, 27, AV_PIX_FMT_YUV420P,
         SWS_BICUBIC, nullptr, nullptr, nullptr
     );
 
-    if (!sws_ctx) {
+    if (!thumb_scale_ctx) {
         return -1;
     }
 
-    AVFrame* frame2 = av_frame_alloc();
-    frame2->width = 48;
-    frame2->height = 27;
-    frame2->format = scaled_pix_fmt;
-    int num_bytes = av_image_get_buffer_size(scaled_pix_fmt, 48, 27, 1);
-    uint8_t* frame2_buffer = (uint8_t*)av_malloc(num_bytes);
-
-    if (!frame2 || !frame2_buffer) {
-        av_free(frame2_buffer);
-        av_frame_free(&frame2);
-        sws_freeContext(sws_ctx);
-        return -1;
+    {
+        ScopedStage timer(metrics, Stage::Scale);
+        sws_scale(thumb_scale_ctx, source->data, source->linesize, 0, source->height, thumb_frame->data, thumb_frame->linesize);
     }
+    thumb_frame->color_range = AVCOL_RANGE_JPEG;
 
-    av_image_fill_arrays(frame2->data, frame2->linesize, frame2_buffer, scaled_pix_fmt, 48, 27, 1);
-    sws_scale(sws_ctx, frame->data, frame->linesize, 0, frame->height, frame2->data, frame2->linesize);
-    frame2->color_range = AVCOL_RANGE_JPEG;
-
-    std::ostringstream path_mini;
-    path_mini << directory << '/' << std::setw(8) << std::setfill('0') << frame_num << "_mini.jpg";
-    saveFrameAsJpeg(scaled_pix_fmt, frame2, path_mini.str());
-
-    av_free(frame2_buffer);
-    av_frame_free(&frame2);
-    sws_freeContext(sws_ctx);
+    saveFrameAsJpeg(jpeg_mini, AV_PIX_FMT_YUV420P, thumb_frame, screenshotPath(directory, frame_num, "_mini"));
     return 0;
 }
 
-int VideoReader::generateScreenshots(const std::string& directory, const std::vector<int>& frameStamps) {
-    AVPacket packet;
+int VideoReader::decodeNextFrame() {
     int response;
-    unsigned int n_frames_extracted = 0;
-    frame_counter = 0;  // Reset frame counter
-    last_fps_report_time = std::chrono::high_resolution_clock::now();  // Reset timing
-
-    while (av_read_frame(format_ctx, &packet) >= 0 && n_frames_extracted < frameStamps.size() && !isCancelled()) {
-        if (packet.stream_index == video_stream_index) {
-            frame_counter++;
-
-            // Report FPS every FPS_REPORT_INTERVAL frames
-            if (frame_counter % FPS_REPORT_INTERVAL == 0) {
-                auto current_time = std::chrono::high_resolution_clock::now();
-                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(current_time - last_fps_report_time).count();
-                double current_fps = (FPS_REPORT_INTERVAL * 1000.0) / elapsed;  // Convert to frames per second
-                fprintf(stderr, "Processing frame %lld, Measured FPS: %.2f\n", frame_counter, current_fps);
-                last_fps_report_time = current_time;
+
+    while (!stopRequested() && readPacket(packet) >= 0) {
+        if (packet->stream_index != video_stream_index) {
+            av_packet_unref(packet);
+            continue;
+        }
+        countFrame();
+
+        response = sendPacket(packet);
+        av_packet_unref(packet);
+        if (response < 0) {
+            return -2;
+        }
+
+        response = receiveFrame(frame);
+        if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
+            continue;
+        } else if (response < 0) {
+            return -2;
+        }
+        return static_cast<int>(codec_ctx->frame_num - 1);
+    }
+    return -1;
+}
+
+int VideoReader::generateScreenshots(const std::string& directory, const std::vector<int>& frameStamps,
+                                     ProgressCallback onProgress,
+                                     ScreenshotCallback onScreenshot) {
+    resetProgress(std::move(onProgress));
+
+    // Frames are decoded in order, so a cursor into the sorted stamps replaces a search per frame
+    std::vector<int> wanted(frameStamps);
+    std::sort(wanted.begin(), wanted.end());
+    wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+    size_t next_wanted = 0;
+    int written = 0;
+
+    while (next_wanted < wanted.size()) {
+        int frame_num = decodeNextFrame();
+        if (frame_num == -2) {
+            failOperation("Failed to decode " + file_path);
+            break;
+        } else if (frame_num < 0) {
+            break;
+        }
+
+        while (next_wanted < wanted.size() && wanted[next_wanted] < frame_num) {
+            next_wanted++;
+        }
+        if (next_wanted < wanted.size() && wanted[next_wanted] == frame_num) {
+            fprintf(stderr, "Extracting frame %d\n", frame_num);
+            next_wanted++;
+            if (saveFrame(directory, frame_num) == 0) {
+                written++;
+                if (onScreenshot) {
+                    onScreenshot(frame_num);
+                }
             }
+        }
+    }
+    return finishOperation() ? written : -1;
+}
 
-            response = avcodec_send_packet(codec_ctx, &packet);
-            if (response < 0) {
-                av_packet_unref(&packet);
-                return -1;
+int VideoReader::exportScreenshots(const std::string& zip_path, const std::vector<ArchiveScreenshot>& screenshots,
+                                   ProgressCallback onProgress,
+                                   ScreenshotCallback onScreenshot) {
+    resetProgress(std::move(onProgress));
+    ZipWriter zip;
+    if (!zip.open(zip_path)) {
+        failOperation("Failed to create " + zip_path);
+        finishOperation();
+        return -1;
+    }
+    const double fps = getFrameRate();
+    int written = 0;
+
+    // Screenshots with an existing file are copied, the others are ordered
+    // by frame and encoded while decoding the video once
+    std::vector<std::pair<int, size_t>> wanted;
+    for (size_t i = 0; i < screenshots.size(); ++i) {
+        const ArchiveScreenshot& screenshot = screenshots[i];
+        if (screenshot.source.empty()) {
+            wanted.emplace_back(screenshot.frame, i);
+            continue;
+        }
+        std::string name = prepareArchiveEntry(zip, screenshot, fps);
+        if (!name.empty()) {
+            ScopedStage timer(metrics, Stage::FileWrite);
+            if (zip.addFileFromDisk(name, screenshot.source)) {
+                written++;
+            } else {
+                fprintf(stderr, "Failed to copy screenshot %s\n", screenshot.source.c_str());
             }
+        }
+    }
+    std::sort(wanted.begin(), wanted.end());
 
-            response = avcodec_receive_frame(codec_ctx, frame);
-            if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
-                av_packet_unref(&packet);
+    size_t next_wanted = 0;
+    while (next_wanted < wanted.size() && last_status == OperationStatus::Ok) {
+        int frame_num = decodeNextFrame();
+        if (frame_num == -2) {
+            failOperation("Failed to decode " + file_path);
+            break;
+        } else if (frame_num < 0) {
+            break;
+        }
+
+        while (next_wanted < wanted.size() && wanted[next_wanted].first < frame_num) {
+            next_wanted++;
+        }
+        if (next_wanted >= wanted.size() || wanted[next_wanted].first != frame_num) {
+            continue;
+        }
+
+        // The encoded JPEG goes straight into every entry asking for this frame
+        AVPixelFormat pix_fmt;
+        AVFrame* source = screenshotFrame(pix_fmt);
+        if (!source || encodeJpeg(jpeg_full, pix_fmt, source) < 0) {
+            failOperation("Failed to encode frame " + std::to_string(frame_num));
+            break;
+        }
+        for (; next_wanted < wanted.size() && wanted[next_wanted].first == frame_num; ++next_wanted) {
+            std::string name = prepareArchiveEntry(zip, screenshots[wanted[next_wanted].second], fps);
+            if (name.empty()) {
                 continue;
-            } else if (response < 0) {
-                av_packet_unref(&packet);
-                return -1;
             }
-
-            if (std::find(frameStamps.begin(), frameStamps.end(), codec_ctx->frame_num -1) != frameStamps.end()) {
-                fprintf(stderr, "Extracting frame %lld\n", (int64_t)(codec_ctx->frame_num - 1));
-                n_frames_extracted++;
-                saveFrame(directory, codec_ctx->frame_num-1);
+            ScopedStage timer(metrics, Stage::FileWrite);
+            if (!zip.addFile(name, jpeg_full.packet->data, jpeg_full.packet->size)) {
+                failOperation("Failed to write " + zip_path);
+                break;
             }
-            av_packet_unref(&packet);
+            written++;
+        }
+        av_packet_unref(jpeg_full.packet);
+        if (last_status == OperationStatus::Ok && onScreenshot) {
+            onScreenshot(frame_num);
         }
-        av_packet_unref(&packet);
     }
-    return 0;
+    if (last_status == OperationStatus::Ok && !stopRequested() && !zip.finish()) {
+        failOperation("Failed to write " + zip_path);
+    }
+
+    // A partial archive is not left behind
+    if (!finishOperation()) {
+        zip.discard();
+        return -1;
+    }
+    return written;
 }
 
-int VideoReader::saveFrameAsJpeg(AVPixelFormat pix_fmt, AVFrame* pFrame, const std::string& path) {
-    int ret;
+AVCodecContext* VideoReader::openJpegEncoder(JpegEncoder& encoder, AVPixelFormat pix_fmt, const AVFrame* pFrame) {
+    AVCodecContext* ctx = encoder.ctx;
+    if (ctx && ctx->pix_fmt == pix_fmt && ctx->width == pFrame->width &&
+        ctx->height == pFrame->height && ctx->color_range == pFrame->color_range) {
+        return ctx;
+    }
+    avcodec_free_context(&encoder.ctx);
 
     const AVCodec* jpegCodec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
     if (!jpegCodec) {
-        return -1;
+        return nullptr;
     }
 
-    AVCodecContext* jpegContext = avcodec_alloc_context3(jpegCodec);
-    if (!jpegContext) {
-        return -1;
+    ctx = avcodec_alloc_context3(jpegCodec);
+    if (!ctx) {
+        return nullptr;
     }
 
-    jpegContext->pix_fmt = pix_fmt;
-    jpegContext->height = pFrame->height;
-    jpegContext->width = pFrame->width;
-    jpegContext->color_range = pFrame->color_range;
-    jpegContext->time_base = AVRational{1, 25};
-    jpegContext->strict_std_compliance = FF_COMPLIANCE_UNOFFICIAL;
+    ctx->pix_fmt = pix_fmt;
+    ctx->height = pFrame->height;
+    ctx->width = pFrame->width;
+    ctx->color_range = pFrame->color_range;
+    ctx->time_base = AVRational{1, 25};
+    ctx->strict_std_compliance = FF_COMPLIANCE_UNOFFICIAL;
 
-    if ((ret = avcodec_open2(jpegContext, jpegCodec, nullptr)) < 0) {
-        printf("ret %d\n", ret);
-        avcodec_free_context(&jpegContext);
-        return ret;
+    int ret;
+    if ((ret = avcodec_open2(ctx, jpegCodec, nullptr)) < 0) {
+        // av_err2str is a C compound literal, which C++ does not take
+        char message[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(ret, message, sizeof(message));
+        std::cerr << "Failed to open the JPEG encoder: " << message << std::endl;
+        avcodec_free_context(&ctx);
+        return nullptr;
+    }
+
+    if (!encoder.packet) {
+        encoder.packet = av_packet_alloc();
+        if (!encoder.packet) {
+            avcodec_free_context(&ctx);
+            return nullptr;
+        }
     }
 
-    AVPacket* packet = av_packet_alloc();
-    if (!packet) {
-        avcodec_free_context(&jpegContext);
+    encoder.ctx = ctx;
+    return ctx;
+}
+
+int VideoReader::encodeJpeg(JpegEncoder& encoder, AVPixelFormat pix_fmt, AVFrame* pFrame) {
+    int ret;
+    ScopedStage encodeTimer(metrics, Stage::JpegEncode);
+
+    // The encoder is kept open between screenshots of the same geometry
+    AVCodecContext* jpegContext = openJpegEncoder(encoder, pix_fmt, pFrame);
+    if (!jpegContext) {
         return -1;
     }
 
     if ((ret = avcodec_send_frame(jpegContext, pFrame)) < 0) {
-        avcodec_free_context(&jpegContext);
         return ret;
     }
 
-    if ((ret = avcodec_receive_packet(jpegContext, packet)) < 0) {
-        av_packet_unref(packet);
-        avcodec_free_context(&jpegContext);
+    if ((ret = avcodec_receive_packet(jpegContext, encoder.packet)) < 0) {
+        av_packet_unref(encoder.packet);
         return ret;
     }
+    return 0;
+}
 
+int VideoReader::saveFrameAsJpeg(JpegEncoder& encoder, AVPixelFormat pix_fmt, AVFrame* pFrame, const std::string& path) {
+    int ret = encodeJpeg(encoder, pix_fmt, pFrame);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ScopedStage writeTimer(metrics, Stage::FileWrite);
     FILE* file = fopen(path.c_str(), "wb");
     if (!file) {
-        av_packet_unref(packet);
-        avcodec_free_context(&jpegContext);
+        av_packet_unref(encoder.packet);
         return -1;
     }
 
-    fwrite(packet->data, 1, packet->size, file);
+    fwrite(encoder.packet->data, 1, encoder.packet->size, file);
     fclose(file);
 
-    av_packet_unref(packet);
-    avcodec_free_context(&jpegContext);
-
+    av_packet_unref(encoder.packet);
     return 0;
 }
 
-void VideoReader::setCancelled(bool value) {
-    cancelled = value;
+void VideoReader::cancel() {
+    stop_requested = true;
+}
+
+bool VideoReader::stopRequested() const {
+    return stop_requested || cancel_generation.load() != operation_generation;
+}
+
+void VideoReader::cancelAll() {
+    cancel_generation++;
+}
+
+OperationStatus VideoReader::lastStatus() const {
+    return last_status;
 }
 
-bool VideoReader::isCancelled() {
-    return cancelled;
+const std::string& VideoReader::lastError() const {
+    return last_error;
 }
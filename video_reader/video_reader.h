@@ -5,6 +5,13 @@
 #include <vector>
 #include <atomic>
 #include <chrono>
+#include <functional>
+#include <memory>
+
+#include "audio_analysis.h"
+#include "media_io.h"
+#include "metrics.h"
+#include "tone_mapping.h"
 
 // FFmpeg Headers
 extern "C" {
@@ -14,22 +21,87 @@ extern "C" {
 #include <libavutil/imgutils.h>
 }
 
+// Snapshot of a running operation, reported every FPS_REPORT_INTERVAL frames
+struct ProgressInfo {
+    int64_t framesDone = 0;
+    int64_t totalFrames = 0;  // 0 if the container does not know the frame count
+    double fps = 0.0;
+    double eta = -1.0;        // Seconds remaining, -1 if unknown
+};
+
+using ProgressCallback = std::function<void(const ProgressInfo&)>;
+// Called as soon as a shot is final, i.e. before DetectShots returns
+using ShotCallback = std::function<void(int start, int end)>;
+// Called after the screenshot of a frame has been written
+using ScreenshotCallback = std::function<void(int frame)>;
+
+// Outcome of the last DetectShots, generateScreenshots or exportScreenshots
+enum class OperationStatus { Ok, Failed, Cancelled };
+
+class ShotModel;
+struct ArchiveScreenshot;
+
+// MJPEG encoder kept open between screenshots of the same geometry
+struct JpegEncoder {
+    AVCodecContext* ctx = nullptr;
+    AVPacket* packet = nullptr;
+};
+
 class VideoReader {
 public:
     explicit VideoReader(const std::string& file_path);
     ~VideoReader();
 
-    std::vector<std::vector<int>> DetectShots(const std::string& onnx_model_path);
+    std::vector<std::vector<int>> DetectShots(const std::string& onnx_model_path,
+                                              ProgressCallback onProgress = nullptr,
+                                              ShotCallback onShot = nullptr);
+    // Uses an already loaded model, e.g. one shared between several readers
+    std::vector<std::vector<int>> DetectShots(ShotModel& model,
+                                              ProgressCallback onProgress = nullptr,
+                                              ShotCallback onShot = nullptr);
     bool Done() const;
-    int generateScreenshots(const std::string& directory, const std::vector<int>& frameStamps);
+    // Returns the number of screenshots written, -1 on decoding errors or if cancelled
+    int generateScreenshots(const std::string& directory, const std::vector<int>& frameStamps,
+                            ProgressCallback onProgress = nullptr,
+                            ScreenshotCallback onScreenshot = nullptr);
     int generateScreenshot(const std::string& directory, int frame);
+    // Writes the screenshots into a new ZIP archive named by timecode. Entries
+    // with a source file are copied, the others are encoded from the video.
+    // Returns the number of screenshots written, -1 on errors or if cancelled.
+    int exportScreenshots(const std::string& zip_path, const std::vector<ArchiveScreenshot>& screenshots,
+                          ProgressCallback onProgress = nullptr,
+                          ScreenshotCallback onScreenshot = nullptr);
     double getFrameRate();
     double getHeight();
     double getNumFrames();
     double getWidth();
     bool Open();
-    static void setCancelled(bool value);
-    static bool isCancelled();
+    // Has to be called before Open()
+    void setIoOptions(const IoOptions& options);
+    // Has to be called before Open(). If enabled, DetectShots also decodes
+    // the first audio stream while reading the video.
+    void setAudioOptions(const AudioOptions& options);
+    // Envelope and shot loudness of the last DetectShots, empty if the audio
+    // analysis is disabled or the video has no audio
+    const AudioAnalysis& getAudioAnalysis() const;
+    // Cancels the operations running in the process when it is called, as
+    // SIGINT and SIGTERM do. Operations started later are not affected.
+    static void cancelAll();
+    // Cancels only the operation running on this instance
+    void cancel();
+    // True if the running operation was cancelled, by cancel() or a signal
+    bool stopRequested() const;
+    // A cancelled DetectShots returns no shots and a cancelled screenshot
+    // operation -1, the status tells them apart from failures
+    OperationStatus lastStatus() const;
+    // Why the last operation failed, empty unless lastStatus() is Failed
+    const std::string& lastError() const;
+
+    // Per-stage timings, queue depths and allocation counts
+    MetricsSnapshot getMetrics() const;
+    void resetMetrics();
+    void setTracing(bool enabled);
+    bool writeTrace(const std::string& path) const;
 
 private:
     std::string file_path;
@@ -37,16 +109,56 @@ private:
     AVCodecContext* codec_ctx = nullptr;
     AVCodecParserContext *parser = nullptr;
     AVFrame* frame = nullptr;
+    AVFrame* prev_frame = nullptr;   // Previous frame while seeking in generateScreenshot
+    AVFrame* thumb_frame = nullptr;  // 48x27 buffer for the _mini thumbnails
+    AVPacket* packet = nullptr;
+    SwsContext* scale_ctx = nullptr;
+    SwsContext* thumb_scale_ctx = nullptr;
+    JpegEncoder jpeg_full;
+    JpegEncoder jpeg_mini;
+    ToneMapper tone_mapper;  // 8-bit copies of high bit depth and HDR frames for the screenshots
+    std::string path_buffer;
     int video_stream_index = -1;
     bool finished = false;
-    FILE *file = nullptr;
-    static std::atomic<bool> cancelled;
+    IoOptions io_options;
+    std::unique_ptr<MediaSource> io_source;
+    AudioOptions audio_options;
+    std::unique_ptr<AudioAnalyzer> audio;  // Only set if enabled and the video has audio
+    AudioAnalysis audio_analysis;
+    static std::atomic<unsigned> cancel_generation;  // Advanced by cancelAll()
+    unsigned operation_generation = 0;               // cancel_generation when the operation started
+    std::atomic<bool> stop_requested{false};
+    OperationStatus last_status = OperationStatus::Ok;
+    std::string last_error;
     int64_t frame_counter = 0;  // Counter for processed frames
     const int FPS_REPORT_INTERVAL = 150;  // Report FPS every 150 frames
     std::chrono::time_point<std::chrono::high_resolution_clock> last_fps_report_time;  // Time of last FPS report
+    ProgressCallback progress_callback;  // Set for the duration of an operation
+    Metrics metrics;
+
+    int readPacket(AVPacket* packet);
+    int sendPacket(const AVPacket* packet);
+    int receiveFrame(AVFrame* out);
 
-    std::vector<uint8_t>& ReadNextFrame(std::vector<uint8_t>& out_frame_data);
-    int saveFrameAsJpeg(AVPixelFormat pix_fmt, AVFrame* pFrame, const std::string& path);
+    void countFrame();
+    void resetProgress(ProgressCallback onProgress);
+    void failOperation(const std::string& message);
+    // Ends the operation, a stop request turns an Ok status into Cancelled.
+    // Returns true if the operation succeeded.
+    bool finishOperation();
+    // Decodes the next frame and writes it scaled to width x height as packed
+    // RGB24, BGR24 or GRAY8 to out_frame_data
+    bool ReadNextFrame(uint8_t* out_frame_data, int width, int height, AVPixelFormat pix_fmt);
+    // Returns the next decoded frame number, -1 at the end and -2 on errors
+    int decodeNextFrame();
+    AVCodecContext* openJpegEncoder(JpegEncoder& encoder, AVPixelFormat pix_fmt, const AVFrame* pFrame);
+    // Leaves the encoded image in encoder.packet
+    int encodeJpeg(JpegEncoder& encoder, AVPixelFormat pix_fmt, AVFrame* pFrame);
+    // The current frame as the JPEG encoders take it, converted to 8-bit full
+    // range if it has more bits or an HDR transfer. nullptr on errors.
+    AVFrame* screenshotFrame(AVPixelFormat& pix_fmt);
+    int saveFrameAsJpeg(JpegEncoder& encoder, AVPixelFormat pix_fmt, AVFrame* pFrame, const std::string& path);
+    const std::string& screenshotPath(const std::string& directory, int frame_num, const char* suffix);
     int saveFrame(const std::string& directory, int frame);
     static void signalHandler(int signum);
 };
@@ -0,0 +1,471 @@
+// Command line driver for batch runs over many videos without the Node.js or
+// Python bindings. The jobs of all files go through one AnalysisScheduler, so
+// shot detection shares a single model and the cores are split between the
+// decoding workers and the inference threads.
+//
+// --screenshots writes the screenshots of every video into a subdirectory
+// named after the file, at the first frame of every shot (with --shots) or
+// every N frames (with --every N). Results are written as JSON or as CSV with
+// one row per file. --profile adds the per-stage timings of every file to
+// the JSON output and prints the timings summed over all files to stderr.
+//
+// Usage: video_reader_cli [--info] [--shots] [--screenshots DIR] [--every N]
+//                         [--model transnetv2.onnx] [--jobs N] [--inference-threads N]
+//                         [--format json|csv] [--output FILE] [--profile]
+//                         [--list files.txt] [video]...
+
+#include "analysis_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::vector<std::string> files;
+    bool info = false;
+    bool shots = false;
+    std::string screenshotDir;
+    int every = 0;
+    std::string model;
+    int jobs = 0;
+    int inferenceThreads = 0;
+    bool csv = false;
+    std::string output;
+    bool profile = false;
+};
+
+struct FileResult {
+    std::string file;
+    std::string screenshotDir;
+    bool hasInfo = false;
+    VideoInfo info;
+    bool hasShots = false;
+    std::vector<std::vector<int>> shots;
+    int screenshots = -1;  // -1 if no screenshots were taken
+    std::vector<std::string> errors;
+    double elapsedMs = 0.0;  // Summed over the jobs of the file
+    std::vector<MetricsSnapshot> metrics;
+    int pending = 0;
+};
+
+std::string csvField(const std::string& value) {
+    if (value.find_first_of(",\"\n\r") == std::string::npos) {
+        return value;
+    }
+    std::string out = "\"";
+    for (char c : value) {
+        out += c == '"' ? "\"\"" : std::string(1, c);
+    }
+    return out + "\"";
+}
+
+// File name without directory and extension, used for the screenshot directory
+std::string stem(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    return dot == std::string::npos || dot == 0 ? name : name.substr(0, dot);
+}
+
+// Sums the stages of several snapshots, min and max over all of them
+MetricsSnapshot sumMetrics(const std::vector<MetricsSnapshot>& snapshots) {
+    MetricsSnapshot total;
+    for (const MetricsSnapshot& snapshot : snapshots) {
+        if (total.stages.empty()) {
+            total.stages = snapshot.stages;
+            total.io = snapshot.io;
+            continue;
+        }
+        for (size_t i = 0; i < total.stages.size() && i < snapshot.stages.size(); ++i) {
+            StageStats& stage = total.stages[i];
+            const StageStats& other = snapshot.stages[i];
+            if (other.count == 0) {
+                continue;
+            }
+            stage.minMs = stage.count == 0 ? other.minMs : std::min(stage.minMs, other.minMs);
+            stage.maxMs = std::max(stage.maxMs, other.maxMs);
+            stage.count += other.count;
+            stage.totalMs += other.totalMs;
+        }
+        total.io.bytesRead += snapshot.io.bytesRead;
+        total.io.bytesConsumed += snapshot.io.bytesConsumed;
+        total.io.reads += snapshot.io.reads;
+        total.io.seeks += snapshot.io.seeks;
+    }
+    return total;
+}
+
+std::string stagesJson(const MetricsSnapshot& snapshot) {
+    std::ostringstream out;
+    out << "{";
+    bool first = true;
+    for (const StageStats& stage : snapshot.stages) {
+        if (stage.count == 0) {
+            continue;
+        }
+        out << (first ? "" : ",") << "\"" << stage.name << "\":{\"count\":" << stage.count
+            << ",\"total_ms\":" << stage.totalMs << ",\"max_ms\":" << stage.maxMs << "}";
+        first = false;
+    }
+    out << "}";
+    return out.str();
+}
+
+// Runs the requested jobs of every file and collects their results. Jobs
+// that depend on others, i.e. screenshots at shot starts or at an interval
+// of the frame count, are submitted from the callback of the job they need.
+class Batch {
+public:
+    Batch(const Options& options, AnalysisScheduler& scheduler) : options(options), scheduler(scheduler) {
+        results.resize(options.files.size());
+        for (size_t i = 0; i < options.files.size(); ++i) {
+            results[i].file = options.files[i];
+        }
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (size_t i = 0; i < results.size(); ++i) {
+            FileResult& result = results[i];
+            if (!options.screenshotDir.empty()) {
+                result.screenshotDir = uniqueScreenshotDir(result.file);
+            }
+            // Video info is fast and may unblock screenshots, so it runs first
+            if (options.info || (options.every > 0 && !options.screenshotDir.empty())) {
+                submit(i, JobType::VideoInfo, {});
+            }
+            if (options.shots) {
+                submit(i, JobType::ShotDetection, {});
+            }
+        }
+        all_done.wait(lock, [this] { return outstanding == 0; });
+    }
+
+    const std::vector<FileResult>& fileResults() const { return results; }
+
+private:
+    std::string uniqueScreenshotDir(const std::string& file) {
+        std::string name = stem(file);
+        int& count = dir_names[name];
+        std::string dir = options.screenshotDir + "/" + name;
+        if (count++ > 0) {
+            dir += "-" + std::to_string(count);
+        }
+        return dir;
+    }
+
+    // Called with the mutex held
+    void submit(size_t index, JobType type, const std::vector<int>& frames) {
+        results[index].pending++;
+        outstanding++;
+        const std::string& file = results[index].file;
+        AnalysisScheduler::Callback done = [this, index](const JobResult& result) { finish(index, result); };
+        int id = -1;
+        switch (type) {
+            case JobType::VideoInfo:
+                id = scheduler.submitVideoInfo(file, 1, done);
+                break;
+            case JobType::ShotDetection:
+                id = scheduler.submitShotDetection(file, 0, done);
+                break;
+            case JobType::Screenshots:
+                mkdir(results[index].screenshotDir.c_str(), 0755);
+                id = scheduler.submitScreenshots(file, results[index].screenshotDir, frames, 0, done);
+                break;
+        }
+        if (id < 0) {
+            // The scheduler is shutting down, done will never be called
+            results[index].errors.push_back("Scheduler is shutting down");
+            results[index].pending--;
+            outstanding--;
+        }
+    }
+
+    void finish(size_t index, const JobResult& job) {
+        std::lock_guard<std::mutex> lock(mutex);
+        FileResult& result = results[index];
+        result.elapsedMs += job.elapsedMs;
+        result.metrics.push_back(job.metrics);
+
+        if (job.status != JobStatus::Done) {
+            result.errors.push_back(job.error.empty() ? jobStatusName(job.status) : job.error);
+        } else if (job.type == JobType::VideoInfo) {
+            result.hasInfo = true;
+            result.info = job.info;
+            if (options.every > 0 && !options.screenshotDir.empty()) {
+                submitScreenshotsEvery(index);
+            }
+        } else if (job.type == JobType::ShotDetection) {
+            result.hasShots = true;
+            result.shots = job.shots;
+            if (options.every <= 0 && !options.screenshotDir.empty()) {
+                std::vector<int> frames;
+                for (const std::vector<int>& shot : job.shots) {
+                    frames.push_back(shot[0]);
+                }
+                submit(index, JobType::Screenshots, frames);
+            }
+        } else {
+            result.screenshots = job.screenshots;
+        }
+
+        result.pending--;
+        if (result.pending == 0) {
+            finished++;
+            fprintf(stderr, "[%zu/%zu] %s%s\n", finished, results.size(), result.file.c_str(),
+                    result.errors.empty() ? "" : " failed");
+        }
+        outstanding--;
+        if (outstanding == 0) {
+            all_done.notify_all();
+        }
+    }
+
+    void submitScreenshotsEvery(size_t index) {
+        FileResult& result = results[index];
+        int numFrames = static_cast<int>(result.info.numFrames);
+        if (numFrames <= 0) {
+            result.errors.push_back("Frame count unknown, no screenshots taken");
+            return;
+        }
+        std::vector<int> frames;
+        for (int frame = 0; frame < numFrames; frame += options.every) {
+            frames.push_back(frame);
+        }
+        submit(index, JobType::Screenshots, frames);
+    }
+
+    const Options& options;
+    AnalysisScheduler& scheduler;
+    std::vector<FileResult> results;
+    std::map<std::string, int> dir_names;
+    std::mutex mutex;
+    std::condition_variable all_done;
+    size_t outstanding = 0;
+    size_t finished = 0;
+};
+
+std::string resultsJson(const std::vector<FileResult>& results, const Options& options, double wallMs) {
+    std::ostringstream out;
+    out << "{\"files\":[";
+    size_t failed = 0;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const FileResult& result = results[i];
+        failed += result.errors.empty() ? 0 : 1;
+        out << (i == 0 ? "" : ",") << "\n{\"file\":" << jsonString(result.file)
+            << ",\"ok\":" << (result.errors.empty() ? "true" : "false");
+        if (result.hasInfo) {
+            out << ",\"info\":{\"fps\":" << result.info.fps << ",\"width\":" << result.info.width
+                << ",\"height\":" << result.info.height << ",\"numFrames\":" << result.info.numFrames << "}";
+        }
+        if (result.hasShots) {
+            out << ",\"shots\":[";
+            for (size_t s = 0; s < result.shots.size(); ++s) {
+                out << (s == 0 ? "" : ",") << "[" << result.shots[s][0] << "," << result.shots[s][1] << "]";
+            }
+            out << "]";
+        }
+        if (result.screenshots >= 0) {
+            out << ",\"screenshots\":" << result.screenshots
+                << ",\"screenshot_dir\":" << jsonString(result.screenshotDir);
+        }
+        if (!result.errors.empty()) {
+            out << ",\"errors\":[";
+            for (size_t e = 0; e < result.errors.size(); ++e) {
+                out << (e == 0 ? "" : ",") << jsonString(result.errors[e]);
+            }
+            out << "]";
+        }
+        out << ",\"elapsed_ms\":" << result.elapsedMs;
+        if (options.profile) {
+            out << ",\"stages\":" << stagesJson(sumMetrics(result.metrics));
+        }
+        out << "}";
+    }
+    out << "\n],\"summary\":{\"files\":" << results.size() << ",\"failed\":" << failed
+        << ",\"wall_ms\":" << wallMs
+        << ",\"files_per_second\":" << (wallMs > 0 ? results.size() * 1000.0 / wallMs : 0.0) << "}}\n";
+    return out.str();
+}
+
+std::string resultsCsv(const std::vector<FileResult>& results) {
+    std::ostringstream out;
+    out << "file,ok,fps,width,height,num_frames,shots,screenshots,elapsed_ms,errors\n";
+    for (const FileResult& result : results) {
+        std::string errors;
+        for (const std::string& error : result.errors) {
+            errors += (errors.empty() ? "" : "; ") + error;
+        }
+        out << csvField(result.file) << "," << (result.errors.empty() ? "true" : "false") << ",";
+        if (result.hasInfo) {
+            out << result.info.fps << "," << result.info.width << "," << result.info.height << ","
+                << result.info.numFrames;
+        } else {
+            out << ",,,";
+        }
+        out << "," << (result.hasShots ? std::to_string(result.shots.size()) : "")
+            << "," << (result.screenshots >= 0 ? std::to_string(result.screenshots) : "")
+            << "," << result.elapsedMs << "," << csvField(errors) << "\n";
+    }
+    return out.str();
+}
+
+void printProfile(const std::vector<FileResult>& results, double wallMs) {
+    std::vector<MetricsSnapshot> all;
+    for (const FileResult& result : results) {
+        all.insert(all.end(), result.metrics.begin(), result.metrics.end());
+    }
+    MetricsSnapshot total = sumMetrics(all);
+
+    fprintf(stderr, "%-12s %12s %12s %10s %10s\n", "stage", "calls", "total ms", "mean ms", "max ms");
+    for (const StageStats& stage : total.stages) {
+        if (stage.count == 0) {
+            continue;
+        }
+        fprintf(stderr, "%-12s %12llu %12.1f %10.3f %10.3f\n", stage.name.c_str(),
+                static_cast<unsigned long long>(stage.count), stage.totalMs,
+                stage.totalMs / stage.count, stage.maxMs);
+    }
+    fprintf(stderr, "%zu files in %.1f s, %.1f MB read\n", results.size(), wallMs / 1000.0,
+            total.io.bytesRead / 1e6);
+}
+
+bool readList(const std::string& path, std::vector<std::string>& files) {
+    std::ifstream file;
+    std::istream* in = &std::cin;
+    if (path != "-") {
+        file.open(path);
+        if (!file) {
+            return false;
+        }
+        in = &file;
+    }
+    std::string line;
+    while (std::getline(*in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty()) {
+            files.push_back(line);
+        }
+    }
+    return true;
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--info") {
+            options.info = true;
+        } else if (arg == "--shots") {
+            options.shots = true;
+        } else if (arg == "--screenshots" && i + 1 < argc) {
+            options.screenshotDir = argv[++i];
+        } else if (arg == "--every" && i + 1 < argc) {
+            options.every = atoi(argv[++i]);
+        } else if (arg == "--model" && i + 1 < argc) {
+            options.model = argv[++i];
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            options.jobs = atoi(argv[++i]);
+        } else if (arg == "--inference-threads" && i + 1 < argc) {
+            options.inferenceThreads = atoi(argv[++i]);
+        } else if (arg == "--format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format != "json" && format != "csv") {
+                return false;
+            }
+            options.csv = format == "csv";
+        } else if (arg == "--output" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (arg == "--profile") {
+            options.profile = true;
+        } else if (arg == "--list" && i + 1 < argc) {
+            if (!readList(argv[++i], options.files)) {
+                std::cerr << "Cannot read " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (!arg.empty() && arg[0] != '-') {
+            options.files.push_back(arg);
+        } else {
+            return false;
+        }
+    }
+
+    if (!options.info && !options.shots && options.screenshotDir.empty()) {
+        options.info = true;
+    }
+    // Screenshots without an interval are taken at the shot starts
+    if (!options.screenshotDir.empty() && options.every <= 0) {
+        options.shots = true;
+    }
+    return !options.files.empty();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--info] [--shots] [--screenshots DIR] [--every N] [--model transnetv2.onnx]"
+                  << " [--jobs N] [--inference-threads N] [--format json|csv] [--output FILE] [--profile]"
+                  << " [--list files.txt] [video]..." << std::endl;
+        return 2;
+    }
+    if (options.shots && options.model.empty()) {
+        std::cerr << "Shot detection needs --model" << std::endl;
+        return 2;
+    }
+    if (!options.screenshotDir.empty()) {
+        mkdir(options.screenshotDir.c_str(), 0755);
+    }
+
+    Clock::time_point start = Clock::now();
+    std::vector<FileResult> results;
+    {
+        AnalysisScheduler scheduler(options.shots ? options.model : "", options.jobs, options.inferenceThreads);
+        std::cerr << "Processing " << options.files.size() << " files with " << scheduler.workerCount()
+                  << " workers" << std::endl;
+        Batch batch(options, scheduler);
+        batch.run();
+        results = batch.fileResults();
+    }
+    double wallMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    std::string text = options.csv ? resultsCsv(results) : resultsJson(results, options, wallMs);
+    if (options.output.empty()) {
+        std::cout << text;
+    } else {
+        std::ofstream file(options.output);
+        file << text;
+        if (!file) {
+            std::cerr << "Failed to write " << options.output << std::endl;
+            return 1;
+        }
+    }
+    if (options.profile) {
+        printProfile(results, wallMs);
+    }
+
+    for (const FileResult& result : results) {
+        if (!result.errors.empty()) {
+            return 1;
+        }
+    }
+    return 0;
+}
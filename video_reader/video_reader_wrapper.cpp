@@ -1,4 +1,173 @@
 #include "video_reader_wrapper.h"
+#include "analysis_scheduler_wrapper.h"
+#include "screenshot_archive.h"
+#include "video_probe.h"
+
+#include <algorithm>
+
+namespace {
+
+// Event passed from the decoding thread to the JS progress callback
+struct ProgressEvent {
+    std::string type;
+    ProgressInfo info;
+    int start = 0;
+    int end = 0;
+    int frame = 0;
+};
+
+void CallProgress(Napi::Env env, Napi::Function jsCallback, ProgressEvent* event) {
+    if (env != nullptr && jsCallback != nullptr) {
+        Napi::Object obj = Napi::Object::New(env);
+        obj.Set("type", event->type);
+        if (event->type == "progress") {
+            obj.Set("framesDone", Napi::Number::New(env, static_cast<double>(event->info.framesDone)));
+            obj.Set("totalFrames", Napi::Number::New(env, static_cast<double>(event->info.totalFrames)));
+            obj.Set("fps", Napi::Number::New(env, event->info.fps));
+            obj.Set("eta", Napi::Number::New(env, event->info.eta));
+        } else if (event->type == "shot") {
+            Napi::Array shotArray = Napi::Array::New(env, 2);
+            shotArray.Set(0u, Napi::Number::New(env, event->start));
+            shotArray.Set(1u, Napi::Number::New(env, event->end));
+            obj.Set("shot", shotArray);
+        } else if (event->type == "screenshot") {
+            obj.Set("frame", Napi::Number::New(env, event->frame));
+        }
+        jsCallback.Call({obj});
+    }
+    delete event;
+}
+
+// Optional progress callback given as second to last argument
+Napi::ThreadSafeFunction CreateProgressFunction(const Napi::CallbackInfo& info, size_t index) {
+    if (info.Length() < index + 2 || !info[index].IsFunction()) {
+        return Napi::ThreadSafeFunction();
+    }
+    return Napi::ThreadSafeFunction::New(
+        info.Env(), info[index].As<Napi::Function>(), "VideoReaderProgress", 0, 1);
+}
+
+ProgressCallback MakeProgressCallback(Napi::ThreadSafeFunction tsfn) {
+    if (static_cast<napi_threadsafe_function>(tsfn) == nullptr) {
+        return nullptr;
+    }
+    return [tsfn](const ProgressInfo& info) mutable {
+        ProgressEvent* event = new ProgressEvent{"progress", info};
+        if (tsfn.BlockingCall(event, CallProgress) != napi_ok) {
+            delete event;
+        }
+    };
+}
+
+// [{ directory, frame, source }], source is optional
+std::vector<ArchiveScreenshot> ParseArchiveScreenshots(Napi::Env env, const Napi::Value& value) {
+    if (!value.IsArray()) {
+        throw Napi::TypeError::New(env, "Screenshots array is required");
+    }
+
+    Napi::Array array = value.As<Napi::Array>();
+    std::vector<ArchiveScreenshot> screenshots;
+    for (uint32_t i = 0; i < array.Length(); ++i) {
+        Napi::Value elem = array[i];
+        if (!elem.IsObject()) {
+            throw Napi::TypeError::New(env, "Screenshot must be an object with directory and frame");
+        }
+        Napi::Object obj = elem.As<Napi::Object>();
+        if (!obj.Get("frame").IsNumber()) {
+            throw Napi::TypeError::New(env, "Screenshot frame must be a number");
+        }
+
+        ArchiveScreenshot screenshot;
+        screenshot.frame = obj.Get("frame").As<Napi::Number>().Int32Value();
+        if (obj.Get("directory").IsString()) {
+            screenshot.directory = obj.Get("directory").As<Napi::String>();
+        }
+        if (obj.Get("source").IsString()) {
+            screenshot.source = obj.Get("source").As<Napi::String>();
+        }
+        screenshots.push_back(screenshot);
+    }
+    return screenshots;
+}
+
+// exportScreenshotFiles(zipPath, screenshots, fps), copies existing files and
+// returns the number of screenshots written
+Napi::Value ExportScreenshotFiles(const Napi::CallbackInfo& info) {
+    if (info.Length() < 3 || !info[0].IsString() || !info[2].IsNumber()) {
+        throw Napi::TypeError::New(info.Env(), "Expected archive path, screenshots and frame rate");
+    }
+
+    std::string zipPath = info[0].As<Napi::String>();
+    std::vector<ArchiveScreenshot> screenshots = ParseArchiveScreenshots(info.Env(), info[1]);
+    double fps = info[2].As<Napi::Number>();
+
+    int written = exportScreenshotFiles(zipPath, screenshots, fps);
+    if (written < 0) {
+        throw Napi::Error::New(info.Env(), "Failed to write " + zipPath);
+    }
+    return Napi::Number::New(info.Env(), written);
+}
+
+Napi::Object VideoInfoObject(Napi::Env env, const VideoInfo& videoInfo) {
+    Napi::Object obj = Napi::Object::New(env);
+    obj.Set("fps", Napi::Number::New(env, videoInfo.fps));
+    obj.Set("width", Napi::Number::New(env, videoInfo.width));
+    obj.Set("height", Napi::Number::New(env, videoInfo.height));
+    obj.Set("numFrames", Napi::Number::New(env, videoInfo.numFrames));
+    return obj;
+}
+
+// probeVideo(path), video info without opening a decoder
+Napi::Value ProbeVideo(const Napi::CallbackInfo& info) {
+    if (info.Length() < 1 || !info[0].IsString()) {
+        throw Napi::TypeError::New(info.Env(), "Expected video path");
+    }
+
+    std::string path = info[0].As<Napi::String>();
+    VideoInfo videoInfo;
+    if (!probeVideo(path, videoInfo)) {
+        throw Napi::Error::New(info.Env(), "Failed to probe " + path);
+    }
+    return VideoInfoObject(info.Env(), videoInfo);
+}
+
+// probeVideos(paths, [threads], callback), probes the files in parallel and
+// calls back with [{ path, ok, fps, width, height, numFrames }]
+Napi::Value ProbeVideos(const Napi::CallbackInfo& info) {
+    size_t last = info.Length() - 1;
+    if (info.Length() < 2 || !info[0].IsArray() || !info[last].IsFunction()) {
+        throw Napi::TypeError::New(info.Env(), "Expected paths array and callback function");
+    }
+
+    Napi::Array array = info[0].As<Napi::Array>();
+    std::vector<std::string> paths;
+    for (uint32_t i = 0; i < array.Length(); ++i) {
+        paths.push_back(array.Get(i).As<Napi::String>());
+    }
+    int threads = info.Length() > 2 && info[1].IsNumber() ? info[1].As<Napi::Number>().Int32Value() : 0;
+
+    auto execFunc = [paths, threads](VideoReader*, std::any& result) {
+        result = probeVideos(paths, threads);
+    };
+    auto resultHandler = [](Napi::Env env, const std::any& result) {
+        const auto& probes = std::any_cast<const std::vector<ProbeResult>&>(result);
+        Napi::Array results = Napi::Array::New(env, probes.size());
+        for (size_t i = 0; i < probes.size(); ++i) {
+            Napi::Object obj = VideoInfoObject(env, probes[i].info);
+            obj.Set("path", probes[i].path);
+            obj.Set("ok", Napi::Boolean::New(env, probes[i].ok));
+            results.Set(i, obj);
+        }
+        return results;
+    };
+
+    Napi::Function callback = info[last].As<Napi::Function>();
+    Worker* worker = new Worker(callback, nullptr, execFunc, resultHandler);
+    worker->Queue();
+    return info.Env().Undefined();
+}
+
+}  // namespace
 
 Napi::Value VideoReaderWrapper::CancelOperation(const Napi::CallbackInfo& info) {
     if (currentWorker) {
@@ -13,9 +182,19 @@ Napi::Value VideoReaderWrapper::DetectShots(const Napi::CallbackInfo& info) {
     }
 
     std::string modelPath = info[0].As<Napi::String>();
-
-    auto execFunc = [modelPath](VideoReader* reader, std::any& result) {
-        result = reader->DetectShots(modelPath);
+    Napi::ThreadSafeFunction progress = CreateProgressFunction(info, 1);
+
+    auto execFunc = [modelPath, progress](VideoReader* reader, std::any& result) mutable {
+        ShotCallback onShot = nullptr;
+        if (static_cast<napi_threadsafe_function>(progress) != nullptr) {
+            onShot = [progress](int start, int end) mutable {
+                ProgressEvent* event = new ProgressEvent{"shot", ProgressInfo(), start, end};
+                if (progress.BlockingCall(event, CallProgress) != napi_ok) {
+                    delete event;
+                }
+            };
+        }
+        result = reader->DetectShots(modelPath, MakeProgressCallback(progress), onShot);
     };
 
     auto resultHandler = [](Napi::Env env, const std::any& result) {
@@ -31,7 +210,7 @@ Napi::Value VideoReaderWrapper::DetectShots(const Napi::CallbackInfo& info) {
         return shotsArray;
     };
 
-    return QueueWorker(info, execFunc, resultHandler);
+    return QueueWorker(info, execFunc, resultHandler, progress);
 }
 
 Napi::Value VideoReaderWrapper::GenerateScreenshots(const Napi::CallbackInfo& info) {
@@ -55,8 +234,20 @@ Napi::Value VideoReaderWrapper::GenerateScreenshots(const Napi::CallbackInfo& in
         frameStamps.push_back(elem.As<Napi::Number>());
     }
 
-    auto execFunc = [directory, frameStamps](VideoReader* reader, std::any& result) {
-        result = reader->generateScreenshots(directory, frameStamps);
+    Napi::ThreadSafeFunction progress = CreateProgressFunction(info, 2);
+
+    auto execFunc = [directory, frameStamps, progress](VideoReader* reader, std::any& result) mutable {
+        ScreenshotCallback onScreenshot = nullptr;
+        if (static_cast<napi_threadsafe_function>(progress) != nullptr) {
+            onScreenshot = [progress](int frame) mutable {
+                ProgressEvent* event = new ProgressEvent{"screenshot", ProgressInfo(), 0, 0, frame};
+                if (progress.BlockingCall(event, CallProgress) != napi_ok) {
+                    delete event;
+                }
+            };
+        }
+        result = reader->generateScreenshots(directory, frameStamps,
+                                             MakeProgressCallback(progress), onScreenshot);
     };
 
     auto resultHandler = [](Napi::Env env, const std::any& result) {
@@ -64,7 +255,36 @@ Napi::Value VideoReaderWrapper::GenerateScreenshots(const Napi::CallbackInfo& in
         return Napi::Boolean::New(env, success >= 0);
     };
 
-    return QueueWorker(info, execFunc, resultHandler);
+    return QueueWorker(info, execFunc, resultHandler, progress);
+}
+
+Napi::Value VideoReaderWrapper::ExportScreenshots(const Napi::CallbackInfo& info) {
+    if (info.Length() < 3 || !info[0].IsString()) {
+        throw Napi::TypeError::New(info.Env(), "Archive path and screenshots array are required");
+    }
+
+    std::string zipPath = info[0].As<Napi::String>();
+    std::vector<ArchiveScreenshot> screenshots = ParseArchiveScreenshots(info.Env(), info[1]);
+    Napi::ThreadSafeFunction progress = CreateProgressFunction(info, 2);
+
+    auto execFunc = [zipPath, screenshots, progress](VideoReader* reader, std::any& result) mutable {
+        ScreenshotCallback onScreenshot = nullptr;
+        if (static_cast<napi_threadsafe_function>(progress) != nullptr) {
+            onScreenshot = [progress](int frame) mutable {
+                ProgressEvent* event = new ProgressEvent{"screenshot", ProgressInfo(), 0, 0, frame};
+                if (progress.BlockingCall(event, CallProgress) != napi_ok) {
+                    delete event;
+                }
+            };
+        }
+        result = reader->exportScreenshots(zipPath, screenshots, MakeProgressCallback(progress), onScreenshot);
+    };
+
+    auto resultHandler = [](Napi::Env env, const std::any& result) {
+        return Napi::Number::New(env, std::any_cast<int>(result));
+    };
+
+    return QueueWorker(info, execFunc, resultHandler, progress);
 }
 
 Napi::Value VideoReaderWrapper::GenerateScreenshot(const Napi::CallbackInfo& info) {
@@ -99,8 +319,16 @@ Napi::Object VideoReaderWrapper::Init(Napi::Env env, Napi::Object exports) {
         InstanceMethod<&VideoReaderWrapper::DetectShots>("detectShots"),
         InstanceMethod<&VideoReaderWrapper::GenerateScreenshots>("generateScreenshots"),
         InstanceMethod<&VideoReaderWrapper::GenerateScreenshot>("generateScreenshot"),
+        InstanceMethod<&VideoReaderWrapper::ExportScreenshots>("exportScreenshots"),
         InstanceMethod<&VideoReaderWrapper::Done>("done"),
         InstanceMethod<&VideoReaderWrapper::CancelOperation>("cancelOperation"),
+        InstanceMethod<&VideoReaderWrapper::GetMetrics>("getMetrics"),
+        InstanceMethod<&VideoReaderWrapper::SetIoOptions>("setIoOptions"),
+        InstanceMethod<&VideoReaderWrapper::SetAudioOptions>("setAudioOptions"),
+        InstanceMethod<&VideoReaderWrapper::GetAudioAnalysis>("getAudioAnalysis"),
+        InstanceMethod<&VideoReaderWrapper::ResetMetrics>("resetMetrics"),
+        InstanceMethod<&VideoReaderWrapper::SetTracing>("setTracing"),
+        InstanceMethod<&VideoReaderWrapper::WriteTrace>("writeTrace"),
     });
 
     constructor = new Napi::FunctionReference();
@@ -154,10 +382,147 @@ Napi::Value VideoReaderWrapper::Done(const Napi::CallbackInfo& info) {
     return Napi::Boolean::New(env, videoReader->Done());
 }
 
+Napi::Value VideoReaderWrapper::GetMetrics(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    MetricsSnapshot snapshot = videoReader->getMetrics();
+
+    Napi::Object stages = Napi::Object::New(env);
+    for (const StageStats& stage : snapshot.stages) {
+        Napi::Object obj = Napi::Object::New(env);
+        obj.Set("count", Napi::Number::New(env, static_cast<double>(stage.count)));
+        obj.Set("totalMs", Napi::Number::New(env, stage.totalMs));
+        obj.Set("minMs", Napi::Number::New(env, stage.minMs));
+        obj.Set("maxMs", Napi::Number::New(env, stage.maxMs));
+        obj.Set("allocations", Napi::Number::New(env, static_cast<double>(stage.allocations)));
+        Napi::Array histogram = Napi::Array::New(env, stage.histogram.size());
+        for (size_t i = 0; i < stage.histogram.size(); ++i) {
+            histogram.Set(i, Napi::Number::New(env, static_cast<double>(stage.histogram[i])));
+        }
+        obj.Set("histogram", histogram);
+        stages.Set(stage.name, obj);
+    }
+
+    Napi::Object queues = Napi::Object::New(env);
+    for (const QueueStats& queue : snapshot.queues) {
+        Napi::Object obj = Napi::Object::New(env);
+        obj.Set("depth", Napi::Number::New(env, static_cast<double>(queue.depth)));
+        obj.Set("maxDepth", Napi::Number::New(env, static_cast<double>(queue.maxDepth)));
+        queues.Set(queue.name, obj);
+    }
+
+    Napi::Object io = Napi::Object::New(env);
+    io.Set("bytesRead", Napi::Number::New(env, static_cast<double>(snapshot.io.bytesRead)));
+    io.Set("bytesConsumed", Napi::Number::New(env, static_cast<double>(snapshot.io.bytesConsumed)));
+    io.Set("reads", Napi::Number::New(env, static_cast<double>(snapshot.io.reads)));
+    io.Set("seeks", Napi::Number::New(env, static_cast<double>(snapshot.io.seeks)));
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("stages", stages);
+    result.Set("queues", queues);
+    result.Set("io", io);
+    return result;
+}
+
+// setAudioOptions({ enabled, envelopeRate }), has to be called before open()
+Napi::Value VideoReaderWrapper::SetAudioOptions(const Napi::CallbackInfo& info) {
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        throw Napi::TypeError::New(info.Env(), "Expected options object");
+    }
+
+    Napi::Object obj = info[0].As<Napi::Object>();
+    AudioOptions options;
+    options.enabled = true;
+    if (obj.Has("enabled")) {
+        options.enabled = obj.Get("enabled").ToBoolean();
+    }
+    if (obj.Has("envelopeRate")) {
+        options.envelopeRate = obj.Get("envelopeRate").As<Napi::Number>().Int32Value();
+    }
+    videoReader->setAudioOptions(options);
+    return info.Env().Undefined();
+}
+
+// Envelope and shot loudness of the last detectShots
+Napi::Value VideoReaderWrapper::GetAudioAnalysis(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    const AudioAnalysis& analysis = videoReader->getAudioAnalysis();
+
+    Napi::Float32Array peak = Napi::Float32Array::New(env, analysis.peak.size());
+    std::copy(analysis.peak.begin(), analysis.peak.end(), peak.Data());
+    Napi::Float32Array rms = Napi::Float32Array::New(env, analysis.rms.size());
+    std::copy(analysis.rms.begin(), analysis.rms.end(), rms.Data());
+
+    Napi::Array shots = Napi::Array::New(env, analysis.shots.size());
+    for (size_t i = 0; i < analysis.shots.size(); ++i) {
+        const ShotLoudness& shot = analysis.shots[i];
+        Napi::Object obj = Napi::Object::New(env);
+        obj.Set("start", Napi::Number::New(env, shot.start));
+        obj.Set("end", Napi::Number::New(env, shot.end));
+        obj.Set("rmsDb", Napi::Number::New(env, shot.rmsDb));
+        obj.Set("peakDb", Napi::Number::New(env, shot.peakDb));
+        shots.Set(i, obj);
+    }
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("sampleRate", Napi::Number::New(env, analysis.sampleRate));
+    result.Set("channels", Napi::Number::New(env, analysis.channels));
+    result.Set("envelopeRate", Napi::Number::New(env, analysis.envelopeRate));
+    result.Set("peak", peak);
+    result.Set("rms", rms);
+    result.Set("shots", shots);
+    return result;
+}
+
+// setIoOptions({ mode: 'auto' | 'ffmpeg' | 'mmap' | 'buffered', blockSize, readAhead })
+Napi::Value VideoReaderWrapper::SetIoOptions(const Napi::CallbackInfo& info) {
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        throw Napi::TypeError::New(info.Env(), "Expected options object");
+    }
+
+    Napi::Object obj = info[0].As<Napi::Object>();
+    IoOptions options;
+    if (obj.Has("mode")) {
+        std::string mode = obj.Get("mode").As<Napi::String>();
+        if (!parseIoMode(mode, options.mode)) {
+            throw Napi::TypeError::New(info.Env(), "Unknown I/O mode " + mode);
+        }
+    }
+    if (obj.Has("blockSize")) {
+        options.blockSize = obj.Get("blockSize").As<Napi::Number>().Int64Value();
+    }
+    if (obj.Has("readAhead")) {
+        options.readAhead = obj.Get("readAhead").As<Napi::Number>().Int32Value();
+    }
+    videoReader->setIoOptions(options);
+    return info.Env().Undefined();
+}
+
+Napi::Value VideoReaderWrapper::ResetMetrics(const Napi::CallbackInfo& info) {
+    videoReader->resetMetrics();
+    return info.Env().Undefined();
+}
+
+Napi::Value VideoReaderWrapper::SetTracing(const Napi::CallbackInfo& info) {
+    if (info.Length() < 1 || !info[0].IsBoolean()) {
+        throw Napi::TypeError::New(info.Env(), "Expected boolean");
+    }
+    videoReader->setTracing(info[0].As<Napi::Boolean>());
+    return info.Env().Undefined();
+}
+
+Napi::Value VideoReaderWrapper::WriteTrace(const Napi::CallbackInfo& info) {
+    if (info.Length() < 1 || !info[0].IsString()) {
+        throw Napi::TypeError::New(info.Env(), "Trace file path is required");
+    }
+    std::string path = info[0].As<Napi::String>();
+    return Napi::Boolean::New(info.Env(), videoReader->writeTrace(path));
+}
+
 Napi::Value VideoReaderWrapper::QueueWorker(
     const Napi::CallbackInfo& info,
     WorkerFunction execFunc,
-    ResultHandler resultFunc) {
+    ResultHandler resultFunc,
+    Napi::ThreadSafeFunction progress) {
 
     Napi::Env env = info.Env();
 
@@ -171,7 +536,8 @@ Napi::Value VideoReaderWrapper::QueueWorker(
         callback,
         videoReader.get(),
         std::move(execFunc),
-        std::move(resultFunc)
+        std::move(resultFunc),
+        progress
     );
 
     currentWorker->Queue();
@@ -180,6 +546,10 @@ Napi::Value VideoReaderWrapper::QueueWorker(
 
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
     VideoReaderWrapper::Init(env, exports);
+    AnalysisSchedulerWrapper::Init(env, exports);
+    exports.Set("exportScreenshotFiles", Napi::Function::New(env, ExportScreenshotFiles));
+    exports.Set("probeVideo", Napi::Function::New(env, ProbeVideo));
+    exports.Set("probeVideos", Napi::Function::New(env, ProbeVideos));
     return exports;
 }
 
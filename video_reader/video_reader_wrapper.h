@@ -26,10 +26,19 @@ private:
     Napi::Value DetectShots(const Napi::CallbackInfo& info);
     Napi::Value GenerateScreenshots(const Napi::CallbackInfo& info);
     Napi::Value GenerateScreenshot(const Napi::CallbackInfo& info);
+    Napi::Value ExportScreenshots(const Napi::CallbackInfo& info);
     Napi::Value CancelOperation(const Napi::CallbackInfo& info);
+    Napi::Value GetMetrics(const Napi::CallbackInfo& info);
+    Napi::Value SetIoOptions(const Napi::CallbackInfo& info);
+    Napi::Value SetAudioOptions(const Napi::CallbackInfo& info);
+    Napi::Value GetAudioAnalysis(const Napi::CallbackInfo& info);
+    Napi::Value ResetMetrics(const Napi::CallbackInfo& info);
+    Napi::Value SetTracing(const Napi::CallbackInfo& info);
+    Napi::Value WriteTrace(const Napi::CallbackInfo& info);
     Napi::Value QueueWorker(const Napi::CallbackInfo& info,
                             WorkerFunction execFunc,
-                            ResultHandler resultFunc);
+                            ResultHandler resultFunc,
+                            Napi::ThreadSafeFunction progress = Napi::ThreadSafeFunction());
 };
 
 #endif
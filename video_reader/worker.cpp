@@ -4,25 +4,38 @@
 Worker::Worker(Napi::Function& callback, 
                VideoReader* videoReader,
                WorkerFunction execFunc,
-               ResultHandler resultFunc)
+               ResultHandler resultFunc,
+               Napi::ThreadSafeFunction progress)
     : Napi::AsyncWorker(callback),
       videoReader(videoReader),
       execFunction(std::move(execFunc)),
-      resultHandler(std::move(resultFunc)) {}
+      resultHandler(std::move(resultFunc)),
+      progressFunction(progress) {}
 
-Worker::~Worker() {}
+Worker::~Worker() {
+    ReleaseProgress();
+}
+
+void Worker::ReleaseProgress() {
+    if (static_cast<napi_threadsafe_function>(progressFunction) != nullptr) {
+        progressFunction.Release();
+        progressFunction = Napi::ThreadSafeFunction();
+    }
+}
 
 void Worker::Cancel() {
     if (videoReader) {
-        videoReader->setCancelled(true);
+        videoReader->cancel();
     }
 }
 
 void Worker::Execute() {
     try {
         execFunction(videoReader, result);
-        if (videoReader->isCancelled()) {
+        if (videoReader && videoReader->lastStatus() == OperationStatus::Cancelled) {
             SetError("Operation cancelled");
+        } else if (videoReader && videoReader->lastStatus() == OperationStatus::Failed) {
+            SetError(videoReader->lastError());
         }
     } catch (const std::exception& e) {
         SetError(e.what());
@@ -30,11 +43,13 @@ void Worker::Execute() {
 }
 
 void Worker::OnOK() {
+    ReleaseProgress();
     Napi::HandleScope scope(Env());
     Napi::Value jsResult = resultHandler(Env(), result);
     Callback().Call({Env().Null(), jsResult});
 }
 
 void Worker::OnError(const Napi::Error& error) {
+    ReleaseProgress();
     Callback().Call({error.Value(), Env().Undefined()});
 }
@@ -15,7 +15,8 @@ public:
     Worker(Napi::Function& callback, 
            VideoReader* videoReader,
            WorkerFunction execFunc,
-           ResultHandler resultFunc);
+           ResultHandler resultFunc,
+           Napi::ThreadSafeFunction progress = Napi::ThreadSafeFunction());
     ~Worker();
     void Cancel();
 
@@ -25,9 +26,12 @@ protected:
     void OnError(const Napi::Error& error) override;
 
 private:
+    void ReleaseProgress();
+
     VideoReader* videoReader;
     WorkerFunction execFunction;
     ResultHandler resultHandler;
+    Napi::ThreadSafeFunction progressFunction;
     std::any result;
 };
 
@@ -0,0 +1,326 @@
+#include "zip_writer.h"
+
+#include <algorithm>
+#include <ctime>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+extern "C" {
+#include <libavutil/crc.h>
+}
+
+namespace {
+
+const uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+const uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+const uint32_t END_SIGNATURE = 0x06054b50;
+const uint32_t ZIP64_END_SIGNATURE = 0x06064b50;
+const uint32_t ZIP64_LOCATOR_SIGNATURE = 0x07064b50;
+
+const uint16_t VERSION_DEFAULT = 20;
+const uint16_t VERSION_ZIP64 = 45;
+const uint16_t FLAG_UTF8 = 1 << 11;
+const uint16_t METHOD_STORE = 0;
+const uint32_t DOS_DIRECTORY = 0x10;
+
+const size_t COPY_BUFFER_SIZE = 1 << 20;
+
+// Offset of the CRC field in the local file header
+const uint64_t LOCAL_HEADER_CRC_OFFSET = 14;
+
+int seekFile(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<int64_t>(offset), SEEK_SET);
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+}
+
+int truncateFile(FILE* file, uint64_t size) {
+    if (fflush(file) != 0) {
+        return -1;
+    }
+#ifdef _WIN32
+    return _chsize_s(_fileno(file), static_cast<int64_t>(size));
+#else
+    return ftruncate(fileno(file), static_cast<off_t>(size));
+#endif
+}
+
+uint32_t updateCrc(uint32_t crc, const uint8_t* data, size_t size) {
+    static const AVCRC* table = av_crc_get_table(AV_CRC_32_IEEE_LE);
+    return av_crc(table, crc, data, size);
+}
+
+}  // namespace
+
+ZipWriter::ZipWriter() {}
+
+ZipWriter::~ZipWriter() {
+    if (file) {
+        fclose(file);
+    }
+}
+
+bool ZipWriter::open(const std::string& path) {
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    this->path = path;
+
+    // All entries get the time the archive was created
+    time_t now = time(nullptr);
+    struct tm local = *localtime(&now);
+    dos_time = static_cast<uint16_t>((local.tm_hour << 11) | (local.tm_min << 5) | (local.tm_sec / 2));
+    dos_date = static_cast<uint16_t>(((local.tm_year - 80) << 9) | ((local.tm_mon + 1) << 5) | local.tm_mday);
+    return true;
+}
+
+bool ZipWriter::hasEntry(const std::string& name) const {
+    return names.count(name) > 0;
+}
+
+bool ZipWriter::addDirectory(const std::string& name) {
+    return beginEntry(name + "/", true) && endEntry();
+}
+
+bool ZipWriter::addFile(const std::string& name, const uint8_t* data, size_t size) {
+    if (!beginEntry(name, false)) {
+        return false;
+    }
+    if (!writeData(data, size)) {
+        abortEntry();
+        return false;
+    }
+    return endEntry();
+}
+
+bool ZipWriter::addFileFromDisk(const std::string& name, const std::string& source_path) {
+    FILE* source = fopen(source_path.c_str(), "rb");
+    if (!source) {
+        return false;
+    }
+    if (copy_buffer.empty()) {
+        copy_buffer.resize(COPY_BUFFER_SIZE);
+    }
+
+    if (!beginEntry(name, false)) {
+        fclose(source);
+        return false;
+    }
+    bool ok = true;
+    while (ok) {
+        size_t n = fread(copy_buffer.data(), 1, copy_buffer.size(), source);
+        if (n == 0) {
+            ok = !ferror(source);
+            break;
+        }
+        ok = writeData(copy_buffer.data(), n);
+    }
+    fclose(source);
+
+    // An unreadable file only loses its own entry, not the archive
+    if (!ok) {
+        abortEntry();
+        return false;
+    }
+    return endEntry();
+}
+
+bool ZipWriter::beginEntry(const std::string& name, bool directory) {
+    if (!file || in_entry || name.empty() || name.size() > 0xffff || !names.insert(name).second) {
+        return false;
+    }
+
+    Entry entry;
+    entry.name = name;
+    entry.offset = position;
+    entry.crc = 0;
+    entry.size = 0;
+    entry.directory = directory;
+    entries.push_back(entry);
+
+    in_entry = true;
+    entry_crc = 0xffffffff;
+    entry_size = 0;
+
+    // CRC and sizes are written by endEntry
+    bool ok = put32(LOCAL_HEADER_SIGNATURE) &&
+           put16(VERSION_DEFAULT) &&
+           put16(FLAG_UTF8) &&
+           put16(METHOD_STORE) &&
+           put16(dos_time) &&
+           put16(dos_date) &&
+           put32(0) &&
+           put32(0) &&
+           put32(0) &&
+           put16(static_cast<uint16_t>(name.size())) &&
+           put16(0) &&
+           write(name.data(), name.size());
+    if (!ok) {
+        abortEntry();
+    }
+    return ok;
+}
+
+bool ZipWriter::writeData(const uint8_t* data, size_t size) {
+    entry_size += size;
+    if (entry_size >= 0xffffffff) {
+        return false;
+    }
+    entry_crc = updateCrc(entry_crc, data, size);
+    return write(data, size);
+}
+
+bool ZipWriter::endEntry() {
+    Entry& entry = entries.back();
+    entry.crc = entry_crc ^ 0xffffffff;
+    entry.size = static_cast<uint32_t>(entry_size);
+    in_entry = false;
+
+    if (entry.size == 0 && entry.crc == 0) {
+        return true;
+    }
+
+    // A failed patch leaves an entry without CRC or the write offset
+    // unknown, neither can be undone
+    uint64_t end = position;
+    if (seekFile(file, entry.offset + LOCAL_HEADER_CRC_OFFSET) != 0) {
+        broken = true;
+        return false;
+    }
+    position = entry.offset + LOCAL_HEADER_CRC_OFFSET;
+    bool ok = put32(entry.crc) && put32(entry.size) && put32(entry.size);
+    position = end;
+    if (!ok || seekFile(file, end) != 0) {
+        broken = true;
+        return false;
+    }
+    return true;
+}
+
+void ZipWriter::abortEntry() {
+    const Entry& entry = entries.back();
+    names.erase(entry.name);
+    position = entry.offset;
+    clearerr(file);
+    if (seekFile(file, position) != 0) {
+        // The next write lands at the wrong offset, which has to fail the archive
+        broken = true;
+    }
+    entries.pop_back();
+    in_entry = false;
+}
+
+bool ZipWriter::finish() {
+    if (!file || in_entry || broken) {
+        return false;
+    }
+
+    uint64_t directoryOffset = position;
+    bool ok = true;
+    for (const Entry& entry : entries) {
+        bool zip64 = entry.offset >= 0xffffffff;
+        ok = ok &&
+             put32(CENTRAL_HEADER_SIGNATURE) &&
+             put16(VERSION_ZIP64) &&
+             put16(zip64 ? VERSION_ZIP64 : VERSION_DEFAULT) &&
+             put16(FLAG_UTF8) &&
+             put16(METHOD_STORE) &&
+             put16(dos_time) &&
+             put16(dos_date) &&
+             put32(entry.crc) &&
+             put32(entry.size) &&
+             put32(entry.size) &&
+             put16(static_cast<uint16_t>(entry.name.size())) &&
+             put16(zip64 ? 12 : 0) &&
+             put16(0) &&
+             put16(0) &&
+             put16(0) &&
+             put32(entry.directory ? DOS_DIRECTORY : 0) &&
+             put32(zip64 ? 0xffffffff : static_cast<uint32_t>(entry.offset)) &&
+             write(entry.name.data(), entry.name.size());
+        if (zip64) {
+            // Extended information extra field holding only the offset
+            ok = ok && put16(0x0001) && put16(8) && put64(entry.offset);
+        }
+    }
+    uint64_t directorySize = position - directoryOffset;
+
+    bool zip64 = entries.size() >= 0xffff || directoryOffset >= 0xffffffff || directorySize >= 0xffffffff;
+    if (zip64) {
+        uint64_t zip64EndOffset = position;
+        ok = ok &&
+             put32(ZIP64_END_SIGNATURE) &&
+             put64(44) &&
+             put16(VERSION_ZIP64) &&
+             put16(VERSION_ZIP64) &&
+             put32(0) &&
+             put32(0) &&
+             put64(entries.size()) &&
+             put64(entries.size()) &&
+             put64(directorySize) &&
+             put64(directoryOffset) &&
+             put32(ZIP64_LOCATOR_SIGNATURE) &&
+             put32(0) &&
+             put64(zip64EndOffset) &&
+             put32(1);
+    }
+
+    uint16_t count = zip64 ? 0xffff : static_cast<uint16_t>(entries.size());
+    ok = ok &&
+         put32(END_SIGNATURE) &&
+         put16(0) &&
+         put16(0) &&
+         put16(count) &&
+         put16(count) &&
+         put32(zip64 ? 0xffffffff : static_cast<uint32_t>(directorySize)) &&
+         put32(zip64 ? 0xffffffff : static_cast<uint32_t>(directoryOffset)) &&
+         put16(0);
+
+    // Cuts off the bytes of aborted entries if nothing overwrote them
+    if (ok && written_end > position) {
+        ok = truncateFile(file, position) == 0;
+    }
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+    return ok;
+}
+
+void ZipWriter::discard() {
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+    if (!path.empty()) {
+        std::remove(path.c_str());
+        path.clear();
+    }
+}
+
+bool ZipWriter::write(const void* data, size_t size) {
+    if (size > 0 && fwrite(data, 1, size, file) != size) {
+        return false;
+    }
+    position += size;
+    written_end = std::max(written_end, position);
+    return true;
+}
+
+bool ZipWriter::put16(uint16_t value) {
+    uint8_t bytes[2] = {static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8)};
+    return write(bytes, sizeof(bytes));
+}
+
+bool ZipWriter::put32(uint32_t value) {
+    return put16(static_cast<uint16_t>(value)) && put16(static_cast<uint16_t>(value >> 16));
+}
+
+bool ZipWriter::put64(uint64_t value) {
+    return put32(static_cast<uint32_t>(value)) && put32(static_cast<uint32_t>(value >> 32));
+}
@@ -0,0 +1,77 @@
+#ifndef ZIP_WRITER_H
+#define ZIP_WRITER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Writes a ZIP archive entry by entry without temporary files. Entries are
+// stored uncompressed, as JPEGs do not shrink any further. The CRC and size
+// of an entry are patched into its local header once its data is written,
+// so the archive has no data descriptors and can be read by every unzip
+// implementation. ZIP64 records are added once the archive passes 4 GB or
+// 65535 entries, single entries have to stay below 4 GB.
+class ZipWriter {
+public:
+    ZipWriter();
+    ~ZipWriter();
+
+    ZipWriter(const ZipWriter&) = delete;
+    ZipWriter& operator=(const ZipWriter&) = delete;
+
+    bool open(const std::string& path);
+
+    // Names use '/' as separator. Adding a name twice fails. A failed add
+    // leaves the archive usable, just without that entry.
+    bool addDirectory(const std::string& name);
+    bool addFile(const std::string& name, const uint8_t* data, size_t size);
+    bool addFileFromDisk(const std::string& name, const std::string& source_path);
+    bool hasEntry(const std::string& name) const;
+    size_t entryCount() const { return entries.size(); }
+
+    // Writes the central directory and closes the file. An archive that is
+    // destroyed without finish() is incomplete.
+    bool finish();
+    // Closes and deletes an archive that will not be finished
+    void discard();
+
+private:
+    struct Entry {
+        std::string name;
+        uint64_t offset;
+        uint32_t crc;
+        uint32_t size;
+        bool directory;
+    };
+
+    bool beginEntry(const std::string& name, bool directory);
+    bool writeData(const uint8_t* data, size_t size);
+    bool endEntry();
+    // Drops the entry being written and rewinds to its local header
+    void abortEntry();
+
+    bool write(const void* data, size_t size);
+    bool put16(uint16_t value);
+    bool put32(uint32_t value);
+    bool put64(uint64_t value);
+
+    FILE* file = nullptr;
+    std::string path;
+    uint64_t position = 0;
+    uint64_t written_end = 0;  // Furthest offset written, beyond position after an aborted entry
+    bool broken = false;
+    uint16_t dos_time = 0;
+    uint16_t dos_date = 0;
+    std::vector<Entry> entries;
+    std::unordered_set<std::string> names;
+    std::vector<uint8_t> copy_buffer;
+
+    // State of the entry currently written
+    bool in_entry = false;
+    uint32_t entry_crc = 0;
+    uint64_t entry_size = 0;
+};
+
+#endif